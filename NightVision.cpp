@@ -6,43 +6,111 @@
 #include <QFile>
 #include <QImage>
 #include <QTime>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QJsonArray>
+#include <QPainter>
+#include <QOpenGLPaintDevice>
+#include <QScreen>
 
 #include <QVector2D>
 #include <QVector3D>
 #include <QMatrix4x4>
 
-#include <gtc/noise.hpp>
+#include "noisegenerator.h"
+#include "noisecache.h"
+
+#include <QtConcurrent>
 
 #include <cmath>
 #include <cstring>
+#include <random>
+
+namespace
+{
+    // Indexed by MyWindow::MaterialId, uploaded as the Materials array of MaterialData
+    const MaterialBlock MaterialTable[] = {
+        // Copper: teapot and torus
+        { { 0.9f * 0.3f, 0.5f * 0.3f, 0.3f * 0.3f, 0.0f }, { 0.9f, 0.5f, 0.3f, 0.0f }, { 0.95f, 0.95f, 0.95f }, 100.0f },
+        // Grey: plane
+        { { 0.2f, 0.2f, 0.2f, 0.0f }, { 0.7f, 0.7f, 0.7f, 0.0f }, { 0.9f, 0.9f, 0.9f }, 180.0f },
+        // Jade and pewter: extra variety for the stress scene
+        { { 0.14f, 0.22f, 0.16f, 0.0f }, { 0.54f, 0.89f, 0.63f, 0.0f }, { 0.32f, 0.32f, 0.32f }, 12.8f },
+        { { 0.11f, 0.06f, 0.11f, 0.0f }, { 0.43f, 0.47f, 0.54f, 0.0f }, { 0.33f, 0.33f, 0.52f }, 9.8f }
+    };
+
+    // LOD chains, coarsest first, and the projected bounding sphere radius in pixels from
+    // which each level is drawn. The default view keeps grid 14 and 50 rings.
+    const int   LodLevels = 4;
+    const int   TeapotGrids[LodLevels]    = { 4, 8, 14, 32 };
+    const int   TorusRings[LodLevels]     = { 12, 25, 50, 100 };
+    const float LodPixelRadius[LodLevels] = { 0.0f, 40.0f, 120.0f, 400.0f };
+
+    // Render scales of the night vision pass1, cycled with the right arrow before the
+    // dynamic resolution
+    const int   RenderScalePresetCount = 3;
+    const float RenderScalePresets[RenderScalePresetCount] = { 1.0f, 0.75f, 0.5f };
+}
 
 MyWindow::~MyWindow()
 {
+    // The GL objects below belong to the render thread's frames
+    if (mRenderThread != 0) {
+        mRenderThread->stop();
+        delete mRenderThread;
+    }
+
     if (mProgram != 0) delete mProgram;
+    if (mTessProgram != 0) delete mTessProgram;
+    if (mCullProgram != 0) delete mCullProgram;
+    if (mHiZProgram != 0) delete mHiZProgram;
+    if (mPass2Program != 0) delete mPass2Program;
+    if (mGoggleProgram != 0) delete mGoggleProgram;
+    if (mOffscreen != 0) delete mOffscreen;
+    delete mContext;
 }
 
-MyWindow::MyWindow()
-    : mProgram(0), currentTimeMs(0), currentTimeS(0), tPrev(0), angle(M_PI/4.0f)
+MyWindow::MyWindow(bool headless, FrameScheduler::Mode frameMode)
+    : mProgram(0), mTessProgram(0), mCullProgram(0), mHiZProgram(0), mPass2Program(0), mGoggleProgram(0), currentTimeS(0), mUpdateSize(true), tPrev(0), angle(M_PI/4.0f),
+      mScheduler(this), mDamageFrames(SettleFrames), mRenderThread(0), mWidth(0), mHeight(0),
+      mHeadless(headless), mInitialized(false), mOffscreen(0), mDefaultFBO(0),
+      mProfiler(ProfilerWindow), mFramesSinceLog(0), mRenderTex(0), mDepthTex(0), mRenderWidth(0), mRenderHeight(0),
+      mPostFBO(0), mPostTex(0), mPostWidth(0), mPostHeight(0),
+      mNoiseTex(0), mNoisePlaceholder(0), mNoisePBO(0), mNoiseTexWidth(0), mNoiseTexHeight(0),
+      mNoiseReadyPending(false), mNoisePhase(0.0f),
+      mGoggleTex(0), mVAOLens(0), mLensBuffer(0), mGoggleWidth(0), mGoggleHeight(0), mGoggleDirty(true)
 {
     setSurfaceType(QWindow::OpenGLSurface);
     setFlags(Qt::Window | Qt::WindowSystemMenuHint | Qt::WindowTitleHint | Qt::WindowMinMaxButtonsHint | Qt::WindowCloseButtonHint);
 
     QSurfaceFormat format;
     format.setDepthBufferSize(24);
+    format.setStencilBufferSize(8);
     format.setMajorVersion(4);
     format.setMinorVersion(3);
     format.setSamples(4);
     format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setSwapInterval(frameMode == FrameScheduler::Uncapped ? 0 : 1);
     setFormat(format);
-    create();
+
+    // Headless rendering goes to an FBO, the offscreen surface only carries the context
+    if (mHeadless) {
+        mOffscreen = new QOffscreenSurface();
+        mOffscreen->setFormat(format);
+        mOffscreen->create();
+    } else {
+        create();
+    }
 
     resize(800, 600);
 
-    mContext = new QOpenGLContext(this);
+    // No parent: the context moves to the render thread
+    mContext = new QOpenGLContext();
     mContext->setFormat(format);
     mContext->create();
 
-    mContext->makeCurrent( this );
+    mContext->makeCurrent( renderSurface() );
 
     mFuncs = mContext->versionFunctions<QOpenGLFunctions_4_3_Core>();
     if ( !mFuncs )
@@ -58,19 +126,30 @@ MyWindow::MyWindow()
 
     initializeOpenGLFunctions();
 
-    QTimer *repaintTimer = new QTimer(this);
-    connect(repaintTimer, &QTimer::timeout, this, &MyWindow::render);
-    repaintTimer->start(1000/60);
+    connect(&mNoiseWatcher, &QFutureWatcherBase::finished, this, &MyWindow::noiseGenerated);
+    GenerateTexture(200.0f, 0.5f, 512, 512, true);
+
+    aSpring.setAmplitude(0.2f);
+    aSpring.setObjectMass(10.0f);
+
+    // Frames of the dynamic resolution should fit the refresh interval
+    double refreshRate = screen() != 0 && screen()->refreshRate() > 0.0 ? screen()->refreshRate() : 60.0;
+    mDynamicResolution.setRange(RenderScalePresets[RenderScalePresetCount - 1], RenderScalePresets[0]);
+    mDynamicResolution.setTarget(1000.0 / refreshRate);
+
+    if (mHeadless) return;
 
-    QTimer *elapsedTimer = new QTimer(this);
-    connect(elapsedTimer, &QTimer::timeout, this, &MyWindow::modCurTime);
-    elapsedTimer->start(1);       
+    // The first frame is scheduled once the window is exposed
+    connect(&mScheduler, &FrameScheduler::frameRequested, this, &MyWindow::render);
+    connect(&mActivityTimer, &QTimer::timeout, this, &MyWindow::logActivity);
+    mScheduler.setMode(frameMode);
+    mScheduler.setRefreshRate(refreshRate);
 }
 
-void MyWindow::modCurTime()
+QSurface *MyWindow::renderSurface()
 {
-    currentTimeMs++;
-    currentTimeS=currentTimeMs/1000.0f;
+    if (mHeadless) return mOffscreen;
+    return this;
 }
 
 void MyWindow::initialize()
@@ -79,126 +158,78 @@ void MyWindow::initialize()
     initShaders();
     pass1Index = mFuncs->glGetSubroutineIndex( mProgram->programId(), GL_FRAGMENT_SHADER, "pass1");
     pass2Index = mFuncs->glGetSubroutineIndex( mProgram->programId(), GL_FRAGMENT_SHADER, "pass2");
+    lensMaskIndex = mFuncs->glGetSubroutineIndex( mProgram->programId(), GL_FRAGMENT_SHADER, "lensMask");
+    transformObjectIndex = mFuncs->glGetSubroutineIndex( mProgram->programId(), GL_VERTEX_SHADER, "transformObject");
+    transformQuadIndex   = mFuncs->glGetSubroutineIndex( mProgram->programId(), GL_VERTEX_SHADER, "transformQuad");
+
+    mTeapotPatches.initialize(mFuncs);
+    initTessellationShaders();
+    initCullShader();
+    initHiZShader();
+    mPass2Program = loadComputeProgram(":/pass2shader.txt", "pass2");
 
     initMatrices();
     setupFBO();
-    GenerateTexture(200.0f, 0.5f, 512, 512, true);
+    initGoggle();
+    initUniformBuffers();
+    initScene();
+    mState.initialize(mFuncs);
+
+    mProfiler.initialize(mFuncs);
+    mScopeFrame  = mProfiler.registerScope("frame",  false);
+    mScopePass1  = mProfiler.registerScope("pass1",  true);
+    mScopePass2  = mProfiler.registerScope("pass2",  true);
+    mScopeHiZ    = mProfiler.registerScope("hiz",    true);
+    mScopeScene  = mProfiler.registerScope("scene",  false);
+    mScopeSwap   = mProfiler.registerScope("swap",   false);
+
+    createNoisePlaceholder();
 
     glFrontFace(GL_CCW);
     glEnable(GL_DEPTH_TEST);
-
-    aSpring.setAmplitude(0.2f);
-    aSpring.setObjectMass(10.0f);
 }
 
 void MyWindow::CreateVertexBuffer()
 {
-    // *** Teapot
-    mFuncs->glGenVertexArrays(1, &mVAOTeapot);
-    mFuncs->glBindVertexArray(mVAOTeapot);
-
+    // Every mesh goes into the shared arena: one VAO, one set of buffers.
+    // The levels of a LOD chain share their quantization bounds, so that one object
+    // record serves every level.
     QMatrix4x4 transform;
     //transform.translate(QVector3D(0.0f, 1.5f, 0.25f));
-    mTeapot = new Teapot(14, transform);
-
-    // Create and populate the buffer objects
-    unsigned int TeapotHandles[3];
-    glGenBuffers(3, TeapotHandles);
-
-    glBindBuffer(GL_ARRAY_BUFFER, TeapotHandles[0]);
-    glBufferData(GL_ARRAY_BUFFER, (3 * mTeapot->getnVerts()) * sizeof(float), mTeapot->getv(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, TeapotHandles[1]);
-    glBufferData(GL_ARRAY_BUFFER, (3 * mTeapot->getnVerts()) * sizeof(float), mTeapot->getn(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, TeapotHandles[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * mTeapot->getnFaces() * sizeof(unsigned int), mTeapot->getelems(), GL_STATIC_DRAW);
-
-    // Setup the VAO
-    // Vertex positions
-    mFuncs->glBindVertexBuffer(0, TeapotHandles[0], 0, sizeof(GLfloat) * 3);
-    mFuncs->glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
-    mFuncs->glVertexAttribBinding(0, 0);
-
-    // Vertex normals
-    mFuncs->glBindVertexBuffer(1, TeapotHandles[1], 0, sizeof(GLfloat) * 3);
-    mFuncs->glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, 0);
-    mFuncs->glVertexAttribBinding(1, 1);
-
-    // Indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, TeapotHandles[2]);
-
-    mFuncs->glBindVertexArray(0);
-
-    // *** Plane
-    mFuncs->glGenVertexArrays(1, &mVAOPlane);
-    mFuncs->glBindVertexArray(mVAOPlane);
-
-    mPlane = new VBOPlane(50.0f, 50.0f, 1.0, 1.0);
-
-    // Create and populate the buffer objects
-    unsigned int PlaneHandles[3];
-    glGenBuffers(3, PlaneHandles);
-
-    glBindBuffer(GL_ARRAY_BUFFER, PlaneHandles[0]);
-    glBufferData(GL_ARRAY_BUFFER, (3 * mPlane->getnVerts()) * sizeof(float), mPlane->getv(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, PlaneHandles[1]);
-    glBufferData(GL_ARRAY_BUFFER, (3 * mPlane->getnVerts()) * sizeof(float), mPlane->getn(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, PlaneHandles[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * mPlane->getnFaces() * sizeof(unsigned int), mPlane->getelems(), GL_STATIC_DRAW);
-
-    // Setup the VAO
-    // Vertex positions
-    mFuncs->glBindVertexBuffer(0, PlaneHandles[0], 0, sizeof(GLfloat) * 3);
-    mFuncs->glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
-    mFuncs->glVertexAttribBinding(0, 0);
-
-    // Vertex normals
-    mFuncs->glBindVertexBuffer(1, PlaneHandles[1], 0, sizeof(GLfloat) * 3);
-    mFuncs->glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, 0);
-    mFuncs->glVertexAttribBinding(1, 1);
-
-    // Indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, PlaneHandles[2]);
-
-    mFuncs->glBindVertexArray(0);
-
-    // *** Torus
-    mFuncs->glGenVertexArrays(1, &mVAOTorus);
-    mFuncs->glBindVertexArray(mVAOTorus);
-
-    //mTorus = new Torus(1.75f * 0.75f, 0.75f * 0.75f, 50, 50);
-    mTorus = new Torus(0.7f * 1.5f, 0.3f * 1.5f, 50, 50);
-
-    // Create and populate the buffer objects
-    unsigned int TorusHandles[3];
-    glGenBuffers(3, TorusHandles);
-
-    glBindBuffer(GL_ARRAY_BUFFER, TorusHandles[0]);
-    glBufferData(GL_ARRAY_BUFFER, (3 * mTorus->getnVerts()) * sizeof(float), mTorus->getv(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, TorusHandles[1]);
-    glBufferData(GL_ARRAY_BUFFER, (3 * mTorus->getnVerts()) * sizeof(float), mTorus->getn(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, TorusHandles[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * mTorus->getnFaces() * sizeof(unsigned int), mTorus->getel(), GL_STATIC_DRAW);
-
-    // Setup the VAO
-    // Vertex positions
-    mFuncs->glBindVertexBuffer(0, TorusHandles[0], 0, sizeof(GLfloat) * 3);
-    mFuncs->glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
-    mFuncs->glVertexAttribBinding(0, 0);
-
-    // Vertex normals
-    mFuncs->glBindVertexBuffer(1, TorusHandles[1], 0, sizeof(GLfloat) * 3);
-    mFuncs->glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, 0);
-    mFuncs->glVertexAttribBinding(1, 1);
+    Teapot *teapots[LodLevels];
+    MeshBounds teapotBounds;
+    for (int i = 0; i < LodLevels; i++) {
+        teapots[i] = new Teapot(TeapotGrids[i], transform);
+        MeshBounds bounds = computeBounds(teapots[i]->getv(), teapots[i]->getnVerts());
+        teapotBounds = i == 0 ? bounds : mergeBounds(teapotBounds, bounds);
+        mTeapotSphere = i == 0 ? teapots[i]->getSphere() : mergeSpheres(mTeapotSphere, teapots[i]->getSphere());
+    }
+    for (int i = 0; i < LodLevels; i++) {
+        mTeapotLevels << mArena.addMesh(teapots[i]->getv(), teapots[i]->getn(), teapots[i]->gettc(), teapots[i]->getnVerts(),
+                                        teapots[i]->getelems(), teapots[i]->getnElems(), &teapotBounds);
+        delete teapots[i];
+    }
 
-    // Indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, TorusHandles[2]);
+    VBOPlane plane(50.0f, 50.0f, 1.0, 1.0);
+    mPlaneLevel = mArena.addMesh(plane.getv(), plane.getn(), plane.gettc(), plane.getnVerts(), plane.getelems(), 6 * plane.getnFaces());
+    mPlaneSphere = plane.getSphere();
+
+    //Torus(1.75f * 0.75f, 0.75f * 0.75f, 50, 50);
+    Torus *tori[LodLevels];
+    MeshBounds torusBounds;
+    for (int i = 0; i < LodLevels; i++) {
+        tori[i] = new Torus(0.7f * 1.5f, 0.3f * 1.5f, TorusRings[i], TorusRings[i]);
+        MeshBounds bounds = computeBounds(tori[i]->getv(), tori[i]->getnVerts());
+        torusBounds = i == 0 ? bounds : mergeBounds(torusBounds, bounds);
+        mTorusSphere = i == 0 ? tori[i]->getSphere() : mergeSpheres(mTorusSphere, tori[i]->getSphere());
+    }
+    for (int i = 0; i < LodLevels; i++) {
+        mTorusLevels << mArena.addMesh(tori[i]->getv(), tori[i]->getn(), tori[i]->gettex(), tori[i]->getnVerts(),
+                                       tori[i]->getel(), 6 * tori[i]->getnFaces(), &torusBounds);
+        delete tori[i];
+    }
 
+    mArena.upload(mFuncs);
 
     // *** Array for full-screen quad
     GLfloat verts[] = {
@@ -235,6 +266,9 @@ void MyWindow::CreateVertexBuffer()
     mFuncs->glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, 0);
     mFuncs->glVertexAttribBinding(2, 2);
 
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(2);
+
     mFuncs->glBindVertexArray(0);
 
 }
@@ -253,63 +287,587 @@ void MyWindow::initMatrices()
 
 void MyWindow::resizeEvent(QResizeEvent *)
 {
-    mUpdateSize = true;
+    // The next snapshot carries the size, see applySnapshot()
+    damage();
+}
+
+bool MyWindow::event(QEvent *event)
+{
+    // requestUpdate() of the vsync paced modes
+    if (event->type() == QEvent::UpdateRequest) {
+        render();
+        return true;
+    }
+    return QWindow::event(event);
+}
+
+void MyWindow::exposeEvent(QExposeEvent *)
+{
+    // Hidden windows schedule nothing, so they never wake up
+    if (mHeadless) return;
+
+    if (isExposed())
+        damage();
+    else
+        mScheduler.stop();
+}
 
-    ProjectionMatrix.setToIdentity();
-    ProjectionMatrix.perspective(60.0f, (float)this->width()/(float)this->height(), 0.3f, 100.0f);
+void MyWindow::damage()
+{
+    mDamageFrames = SettleFrames;
+    if (!mHeadless && isExposed())
+        mScheduler.schedule();
+}
+
+void MyWindow::setRenderOnDemand(bool enabled)
+{
+    OnDemand = enabled;
+    damage();
+}
+
+void MyWindow::logActivity()
+{
+    qDebug() << "activity" << mScheduler.getWakeupRate() << "wakeups/s" << mScheduler.getFrameRate() << "frames/s";
+}
+
+void MyWindow::setFixedFrameRate(double framesPerSecond)
+{
+    mScheduler.setFixedRate(framesPerSecond);
 }
 
 void MyWindow::render()
 {
+    mScheduler.wakeup();
+
+    // Not rescheduled: exposeEvent() starts again
     if(!isVisible() || !isExposed())
         return;
 
-    if (!mContext->makeCurrent(this))
-        return;
+    // The constructor left the context current here; from now on it is the thread's
+    if (mRenderThread == 0) {
+        mContext->doneCurrent();
+        mRenderThread = new RenderThread(mContext, this, [this](const FrameSnapshot& frame) { renderSnapshot(frame); });
+        connect(mRenderThread, &RenderThread::frameDone, this, &MyWindow::frameDone);
+        mRenderThread->start();
+    }
+
+    mScheduler.beginFrame();
+    FrameSnapshot frame = makeSnapshot(mScheduler.getTime());
+
+    // Only when frames were asked for faster than they complete: the frames in flight
+    // will schedule again, the noise waits for the next snapshot
+    if (!mRenderThread->post(frame) && !frame.noise.isEmpty()) {
+        mNoiseReady        = frame.noise;
+        mNoiseMapping      = frame.noiseMapping;
+        mNoiseReadyPending = true;
+    }
+}
+
+void MyWindow::frameDone()
+{
+    // On demand, the last frame stays on screen until something changes
+    if (mDamageFrames > 0) mDamageFrames--;
+    mScheduler.endFrame(!OnDemand || SpringAnimate || mDamageFrames > 0);
+}
+
+FrameSnapshot MyWindow::makeSnapshot(double time)
+{
+    FrameSnapshot frame = mGuiState;
+    frame.time   = time;
+    frame.width  = this->width();
+    frame.height = this->height();
 
-    static bool initialized = false;
-    if (!initialized) {
+    static float EvolvingVal = 0;
+
+    frame.view.setToIdentity();
+    frame.view.lookAt(QVector3D(7.0f * cos(M_PI/4.0f),4.0f,7.0f * sin(M_PI/4.0f)), QVector3D(0.0f,0.0f,0.0f), QVector3D(0.0f,1.0f,0.0f));
+    if (SpringAnimate == true)
+    {
+        EvolvingVal += 0.01f;
+        qDebug() << "EvolvingVal " << EvolvingVal << endl;
+    }
+    double springMotion =aSpring.calcMotion((double)EvolvingVal);
+    frame.view.translate(0.0f, springMotion, 0.0f);
+    prepareFrame(frame);
+
+    if (mNoiseReadyPending) {
+        frame.noise        = mNoiseReady;
+        frame.noiseMapping = mNoiseMapping;
+        frame.noiseWidth   = mNoiseInFlight.w;
+        frame.noiseHeight  = mNoiseInFlight.h;
+        mNoiseReady.clear();
+        mNoiseReadyPending = false;
+    }
+
+    if (NoiseAnimate && !mNoiseWatcher.isRunning() && !mNoiseReadyPending) {
+        NoiseRequest request = mNoiseInFlight;
+        mNoisePhase += 0.37f;
+        request.offsetX = mNoisePhase;
+        request.offsetY = 0.61f * mNoisePhase;
+        request.cached  = false;
+        startNoiseJob(request);
+    }
+
+    if (frame.profileLog)
+        frame.intervalSummary = mScheduler.getHistogram().summary();
+
+    if (frame.showOverlay && !mHeadless) {
+        frame.schedulerLines << QString("frames: %1%2  interval %3  missed %4")
+                                .arg(FrameScheduler::getModeName(mScheduler.getMode()))
+                                .arg(mScheduler.getMode() == FrameScheduler::FixedRate ? QString(" %1 Hz").arg(mScheduler.getFixedRate())
+                                     : mScheduler.isHalfRate() ? QString(" half rate") : QString())
+                                .arg(mScheduler.getHistogram().summary())
+                                .arg(mScheduler.getMissedCount());
+        frame.schedulerLines << QString("activity: %1 wakeups/s  %2 frames/s%3")
+                                .arg(mScheduler.getWakeupRate(), 0, 'f', 1)
+                                .arg(mScheduler.getFrameRate(), 0, 'f', 1)
+                                .arg(OnDemand ? "  on demand" : "");
+    }
+
+    return frame;
+}
+
+void MyWindow::renderSnapshot(const FrameSnapshot& frame)
+{
+    if (!mInitialized) {
+        mWidth  = frame.width;
+        mHeight = frame.height;
         initialize();
-        initialized = true;
+        mInitialized = true;
+    }
+
+    applySnapshot(frame);
+    renderFrame();
+}
+
+void MyWindow::applySnapshot(const FrameSnapshot& frame)
+{
+    // Work triggered by a change is done against the previous snapshot
+    if (frame.width != mApplied.width || frame.height != mApplied.height) {
+        mWidth       = frame.width;
+        mHeight      = frame.height;
+        mUpdateSize  = true;
+        mPostClear   = true;
+        mGoggleDirty = true;
+    }
+
+    if (frame.stressCount != mApplied.stressCount || frame.stressRandom != mApplied.stressRandom) {
+        StressRandom = frame.stressRandom;
+        buildScene(frame.stressCount);
     }
 
+    if (frame.gpuCulling != mApplied.gpuCulling)
+        mScene.setGpuCulling(frame.gpuCulling);
+
+    if (frame.dynamicScale && !mApplied.dynamicScale)
+        mDynamicResolution.reset(frame.renderScale);
+
+    if (!frame.noise.isEmpty())
+        uploadNoise(frame.noise, frame.noiseWidth, frame.noiseHeight, !frame.noiseMapping.isNull());
+
+    currentTimeS       = frame.time;
+    ViewMatrix         = frame.view;
+    ProjectionMatrix   = frame.projection;
+    NightVision        = frame.nightVision;
+    ShowOverlay        = frame.showOverlay;
+    ProfileLog         = frame.profileLog;
+    TeapotTessellation = frame.teapotTessellation;
+    OcclusionCulling   = frame.occlusionCulling;
+    ComputePass2       = frame.computePass2;
+    DynamicScale       = frame.dynamicScale;
+    RenderScale        = frame.renderScale;
+
+    // The texels are uploaded, neither they nor the mapping need live on
+    mApplied       = frame;
+    mApplied.noise = QByteArray();
+    mApplied.noiseMapping.clear();
+}
+
+void MyWindow::renderFrame()
+{
+    mProfiler.beginFrame();
+    mProfiler.beginScope(mScopeFrame);
+
     if (mUpdateSize) {
-        glViewport(0, 0, size().width(), size().height());
+        glViewport(0, 0, mWidth, mHeight);
         mUpdateSize = false;
     }
 
+    if (NightVision && renderSize() != QSize(mRenderWidth, mRenderHeight))
+        resizeRenderTarget();
+
+    if (NightVision && ComputePass2 && QSize(mWidth, mHeight) != QSize(mPostWidth, mPostHeight))
+        resizePostTarget();
+
     float deltaT = currentTimeS - tPrev;
     if(tPrev == 0.0f) deltaT = 0.0f;
     tPrev = currentTimeS;
     angle += 0.25f * deltaT;
     if (angle > TwoPI) angle -= TwoPI;
 
-    static float EvolvingVal = 0;    
+    updateFrameUniforms();
 
-    ViewMatrix.setToIdentity();
-    ViewMatrix.lookAt(QVector3D(7.0f * cos(M_PI/4.0f),4.0f,7.0f * sin(M_PI/4.0f)), QVector3D(0.0f,0.0f,0.0f), QVector3D(0.0f,1.0f,0.0f));
-    if (SpringAnimate == true)
-    {
-        EvolvingVal += 0.01f;
-        qDebug() << "EvolvingVal " << EvolvingVal << endl;
-    }
-    double springMotion =aSpring.calcMotion((double)EvolvingVal);
-    ViewMatrix.translate(0.0f, springMotion, 0.0f);
+    mState.beginFrame();
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     if (NightVision == false) {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        pass1();
-        mContext->swapBuffers(this);
+        mState.bindFramebuffer(GL_FRAMEBUFFER, mDefaultFBO);
+        {
+            Profiler::Scoped scope(mProfiler, mScopePass1);
+            pass1();
+        }
+        mScene.setOcclusion(0, QMatrix4x4());
     } else {
-        glBindFramebuffer(GL_FRAMEBUFFER, mFBOHandle);
-        pass1();
+        mState.bindFramebuffer(GL_FRAMEBUFFER, mFBOHandle);
+        glViewport(0, 0, mRenderWidth, mRenderHeight);
+        {
+            Profiler::Scoped scope(mProfiler, mScopePass1);
+            pass1();
+        }
+
+        // Depth pyramid for the occlusion test of the next frame's GPU culling
+        if (OcclusionCulling && mScene.isGpuCulling()) {
+            Profiler::Scoped scope(mProfiler, mScopeHiZ);
+            mHiZ.build(mDepthTex);
+            mState.invalidate(GLStateCache::ProgramState | GLStateCache::TextureState);
+            mScene.setOcclusion(&mHiZ, mApplied.viewProjection);
+        } else {
+            mScene.setOcclusion(0, QMatrix4x4());
+        }
+
+        mState.bindFramebuffer(GL_FRAMEBUFFER, mDefaultFBO);
+        glViewport(0, 0, mWidth, mHeight);
+        {
+            Profiler::Scoped scope(mProfiler, mScopePass2);
+            if (ComputePass2 && mPass2Program != 0)
+                pass2Compute();
+            else
+                pass2();
+        }
+    }
+
+    mUniformRing.endFrame();
+
+    // Code outside the cache binds on unit 0 without selecting it
+    mState.activeTexture(0);
+
+    if (ShowOverlay)
+        drawOverlay();
+
+    mProfiler.endScope(mScopeFrame);
+
+    {
+        Profiler::Scoped scope(mProfiler, mScopeSwap);
+        present();
+    }
+
+    mProfiler.endFrame();
+
+    // GPU times arrive a couple of frames late: the controller's cooldown covers that
+    if (NightVision && DynamicScale)
+        mDynamicResolution.update(mProfiler.getGpuStats(mScopePass1).getLast() + mProfiler.getGpuStats(mScopePass2).getLast());
+
+    if (ProfileLog && ++mFramesSinceLog >= 300) {
+        foreach (const QString& line, mProfiler.report())
+            qDebug() << qPrintable(line);
+        qDebug() << "frame interval" << qPrintable(mApplied.intervalSummary);
+        qDebug() << "GL state calls" << mState.getIssued() << "issued" << mState.getFiltered() << "filtered";
+        mFramesSinceLog = 0;
+    }
+}
+
+void MyWindow::present()
+{
+    if (!mHeadless)
+        mContext->swapBuffers(this);
+}
+
+void MyWindow::drawOverlay()
+{
+    QStringList lines = mProfiler.report();
+
+    double avgFrameMs = mProfiler.getFrameIntervalStats().getAvg();
+    double trianglesPerSecond = avgFrameMs > 0.0 ? mScene.getTriangleCount() * 1000.0 / avgFrameMs : 0.0;
+    lines << QString("objects %1  triangles %2  %3 Mtri/s")
+             .arg(mScene.getObjectCount())
+             .arg(mScene.getTriangleCount())
+             .arg(trianglesPerSecond / 1.0e6, 0, 'f', 1);
+    lines << QString("culling (%1)  drawn %2  culled %3  occluded %4")
+             .arg(cullingName())
+             .arg(mScene.getDrawnCount())
+             .arg(mScene.getCulledCount())
+             .arg(mScene.getOccludedCount());
+    lines << QString("lod  teapot %1  torus %2")
+             .arg(levelSummary(mMeshTeapot))
+             .arg(levelSummary(mMeshTorus));
+    lines << mApplied.schedulerLines;
+    lines << QString("uniform ring: %1 frames in flight  fence wait %2 ms")
+             .arg(mUniformRing.getFramesInFlight())
+             .arg(mUniformRing.getWaitMs(), 0, 'f', 3);
+    lines << QString("GL state: %1 calls issued  %2 filtered")
+             .arg(mState.getIssued())
+             .arg(mState.getFiltered());
+    lines << QString("render scale %1  %2x%3%4")
+             .arg(renderScale(), 0, 'f', 2)
+             .arg(mRenderWidth)
+             .arg(mRenderHeight)
+             .arg(DynamicScale ? QString("  dynamic, %1 / %2 ms")
+                                     .arg(mDynamicResolution.getSmoothedMs(), 0, 'f', 2)
+                                     .arg(mDynamicResolution.getTarget(), 0, 'f', 2)
+                               : QString());
+    lines << QString("pass2: %1").arg(ComputePass2 && mPass2Program != 0 ? "compute, 16x16 tiles" : "raster quad");
+    lines << (TeapotTessellation ? QString("teapot: GPU tessellation, %1 bytes of patches").arg(mTeapotPatches.getByteCount())
+                                 : QString("teapot: CPU mesh"));
+
+    QOpenGLPaintDevice device(QSize(mWidth, mHeight));
+    QPainter painter(&device);
+    painter.setFont(QFont("Monospace", 9));
+    painter.setRenderHint(QPainter::TextAntialiasing);
+
+    QFontMetrics metrics = painter.fontMetrics();
+    int lineHeight = metrics.height();
+    int boxWidth = 0;
+    foreach (const QString& line, lines)
+        boxWidth = qMax(boxWidth, metrics.horizontalAdvance(line));
+
+    painter.fillRect(4, 4, boxWidth + 12, lineHeight * lines.size() + 8, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    for (int i = 0; i < lines.size(); i++)
+        painter.drawText(10, 8 + metrics.ascent() + i * lineHeight, lines[i]);
+    painter.end();
+
+    // QPainter leaves its own GL state behind
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_STENCIL_TEST);
+    glStencilMask(0xFF);
+    glFrontFace(GL_CCW);
+    mUpdateSize = true;
+}
+
+QString MyWindow::levelSummary(int mesh) const
+{
+    QStringList counts;
+    for (int level = 0; level < mScene.getLevelCount(mesh); level++)
+        counts << QString::number(mScene.getLevelObjects(mesh, level));
+    return counts.join('/');
+}
+
+QJsonArray MyWindow::levelObjects(int mesh) const
+{
+    QJsonArray counts;
+    for (int level = 0; level < mScene.getLevelCount(mesh); level++)
+        counts.append(mScene.getLevelObjects(mesh, level));
+    return counts;
+}
+
+void MyWindow::createHeadlessTarget()
+{
+    // Stands in for the window's default framebuffer
+    glGenFramebuffers(1, &mDefaultFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, mDefaultFBO);
+
+    GLuint renderBuffers[2];
+    glGenRenderbuffers(2, renderBuffers);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, renderBuffers[0]);
+    mFuncs->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, mWidth, mHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderBuffers[0]);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, renderBuffers[1]);
+    mFuncs->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mWidth, mHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderBuffers[1]);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        qWarning( "Headless framebuffer is incomplete" );
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+QJsonObject MyWindow::runBenchmark(int frames, float timestep, int stressCount, bool sweep)
+{
+    mContext->makeCurrent(renderSurface());
+
+    // No render thread here: snapshots are made and applied on this thread
+    if (!mInitialized) {
+        mWidth  = this->width();
+        mHeight = this->height();
+        initialize();
+        createHeadlessTarget();
+        mInitialized = true;
+    }
+    mUpdateSize = true;
+
+    // Both modes are measured with the final noise texture, not the placeholder
+    mNoiseWatcher.waitForFinished();
+    QCoreApplication::processEvents();
+
+    mGuiState.stressCount = sweep ? 0 : stressCount;
+    applySnapshot(makeSnapshot(currentTimeS));
+
+    QJsonObject report;
+    report["renderer"] = QString((const char *)glGetString(GL_RENDERER));
+    report["width"]    = this->width();
+    report["height"]   = this->height();
+    report["frames"]   = frames;
+    report["timestep"] = timestep;
+    report["teapot"]   = TeapotTessellation ? "gpu_tessellation" : "cpu_mesh";
+    report["culling"]  = cullingName();
+    report["occlusion"] = OcclusionCulling && mScene.isGpuCulling();
+    if (DynamicScale)
+        report["render_scale"] = "dynamic";
+    else
+        report["render_scale"] = RenderScale;
+
+    if (!sweep) {
+        report["modes"] = benchmarkScene(frames, timestep);
+        return report;
+    }
+
+    // Doubles the instance count up to stressCount to find where throughput collapses
+    QJsonArray runs;
+    for (int count = 1; count <= stressCount; count *= 2) {
+        mGuiState.stressCount = count;
+        applySnapshot(makeSnapshot(currentTimeS));
+        runs.append(benchmarkScene(frames, timestep));
+    }
+    report["sweep"] = runs;
+
+    return report;
+}
+
+QJsonObject MyWindow::benchmarkScene(int frames, float timestep)
+{
+    mScene.setCamera(ViewMatrix, ProjectionMatrix, mHeight);
+    mScene.update();
+
+    QJsonObject result;
+    result["instances"] = StressCount;
+    result["objects"]   = mScene.getObjectCount();
+    result["triangles"] = (double)mScene.getTriangleCount();
+    result["normal"]      = benchmarkMode(false, frames, timestep);
+
+    mGuiState.computePass2 = false;
+    QJsonObject raster = benchmarkMode(true, frames, timestep);
+    result["nightvision"] = raster;
+
+    // Snapshots made on this thread and drawn on a render thread, as in a window: what
+    // overlapping the CPU preparation with the submission buys
+    QJsonObject pipelined = benchmarkMode(true, frames, timestep, true);
+    result["nightvision_pipelined"] = pipelined;
+    result["pipeline_speedup"] = raster["frame_ms"].toDouble() / pipelined["frame_ms"].toDouble();
+
+    // Single thread, the CPU waiting for each frame on the GPU: what the fenced ring buys
+    mUniformRing.setFramesInFlight(1);
+    QJsonObject serialized = benchmarkMode(true, frames, timestep);
+    mUniformRing.setFramesInFlight(UniformRing::Segments);
+    result["nightvision_serialized"] = serialized;
+    result["fence_limited_speedup"] = serialized["frame_ms"].toDouble() / raster["frame_ms"].toDouble();
+
+    if (mPass2Program != 0) {
+        mGuiState.computePass2 = true;
+        QJsonObject compute = benchmarkMode(true, frames, timestep);
+        result["nightvision_compute"] = compute;
+
+        // Keep the faster post-process on this device
+        mGuiState.computePass2 = compute["pass2_gpu_ms"].toDouble() < raster["pass2_gpu_ms"].toDouble();
+        result["pass2"] = mGuiState.computePass2 ? "compute" : "raster";
+    }
+    return result;
+}
+
+QJsonObject MyWindow::benchmarkMode(bool nightVision, int frames, float timestep, bool threaded)
+{
+    const int warmupFrames = 10;
+
+    // The renderer owns currentTimeS: snapshots are made from this one
+    double time = 0.0;
+
+    mGuiState.nightVision = nightVision;
+    tPrev = 0.0f;
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        pass2();
+    for (int i = 0; i < warmupFrames; i++) {
+        renderSnapshot(makeSnapshot(time));
+        time += timestep;
     }
+
+    // Keep every sample of the run in the profiler window
+    glFinish();
+    mProfiler.flush();
+    mProfiler.setWindow(frames);
+
+    // Renderer side counters, only read once the render thread is joined
+    double waitMs   = 0.0;
+    int    issued   = 0;
+    int    filtered = 0;
+    RenderThread::RenderFunction render = [&](const FrameSnapshot& frame) {
+        renderSnapshot(frame);
+        waitMs   += mUniformRing.getWaitMs();
+        issued   += mState.getIssued();
+        filtered += mState.getFiltered();
+    };
+
+    RenderThread *thread = 0;
+    if (threaded) {
+        mContext->doneCurrent();
+        thread = new RenderThread(mContext, renderSurface(), render);
+        thread->start();
+    }
+
+    QElapsedTimer wallTimer;
+    wallTimer.start();
+
+    qint64 prepareNs = 0;
+    for (int i = 0; i < frames; i++) {
+        QElapsedTimer prepareTimer;
+        prepareTimer.start();
+        FrameSnapshot frame = makeSnapshot(time);
+        prepareNs += prepareTimer.nsecsElapsed();
+
+        if (thread == 0)
+            render(frame);
+        else
+            while (!thread->post(frame))
+                QThread::yieldCurrentThread();
+        time += timestep;
+    }
+
+    if (thread != 0) {
+        // Returns once the queued frames are drawn, with the context back on this thread
+        thread->stop();
+        delete thread;
+        mContext->makeCurrent(renderSurface());
+    }
+
+    glFinish();
+    qint64 wallNs = wallTimer.nsecsElapsed();
+    mProfiler.flush();
+
+    QJsonObject result;
+    result["frames_per_second"]    = frames / (wallNs / 1.0e9);
+    result["triangles_per_second"] = mScene.getTriangleCount() * (frames / (wallNs / 1.0e9));
+    result["frame_ms"]             = wallNs / 1.0e6 / frames;
+    result["prepare_ms"]           = prepareNs / 1.0e6 / frames;
+    result["fence_wait_ms"]        = waitMs / frames;
+    result["frames_in_flight"]     = mUniformRing.getFramesInFlight();
+    result["render_thread"]        = threaded;
+    result["state_calls_issued"]   = (double)issued / frames;
+    result["state_calls_filtered"] = (double)filtered / frames;
+    result["scopes"]               = mProfiler.toJson();
+    result["pass2_gpu_ms"]         = mProfiler.getGpuStats(mScopePass2).getAvg();
+    result["drawn"]                = mScene.getDrawnCount();
+    result["culled"]               = mScene.getCulledCount();
+    result["occluded"]             = mScene.getOccludedCount();
+    result["teapot_levels"]        = levelObjects(mMeshTeapot);
+    result["torus_levels"]         = levelObjects(mMeshTorus);
+    if (nightVision)
+        result["render_scale"]     = renderScale();
+
+    mProfiler.setWindow(ProfilerWindow);
+
+    return result;
 }
 
 void MyWindow::pass1()
@@ -317,149 +875,344 @@ void MyWindow::pass1()
     glClearColor(0.5f,0.5f,0.5f,1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // *** Draw teapot
-    mFuncs->glBindVertexArray(mVAOTeapot);       
+    // *** Draw teapot, plane and torus in a single indirect call
+    mProfiler.beginScope(mScopeScene);
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+    // The culling pass binds its own program and the depth pyramid
+    mScene.update();
+    mState.invalidate(GLStateCache::ProgramState | GLStateCache::TextureState);
 
-    QVector4D worldLight = QVector4D(0.0f, 0.0f, 0.0f, 1.0f);
+    mState.useProgram(mProgram->programId());
+    mState.setSubroutine(GL_VERTEX_SHADER,   transformObjectIndex);
+    mState.setSubroutine(GL_FRAGMENT_SHADER, pass1Index);
 
-    mProgram->bind();
-    {        
-        mFuncs->glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &pass1Index);
+    mScene.draw(TeapotTessellation ? mMeshTeapot : -1);
+    mState.invalidate(GLStateCache::VertexArrayState);
 
-        mProgram->setUniformValue("Light.Position",  worldLight );
-        mProgram->setUniformValue("Light.Intensity", QVector3D(1.0f, 1.0f, 1.0f));
+    if (TeapotTessellation)
+        drawTeapotPatches();
 
-        QMatrix4x4 mv1 = ViewMatrix * ModelMatrixTeapot;
-        mProgram->setUniformValue("ModelViewMatrix", mv1);
-        mProgram->setUniformValue("NormalMatrix", mv1.normalMatrix());
-        mProgram->setUniformValue("MVP", ProjectionMatrix * mv1);
+    mProfiler.endScope(mScopeScene);
+}
 
-        mProgram->setUniformValue("Worldlight",       worldLight);
-        mProgram->setUniformValue("ViewNormalMatrix", ViewMatrix.normalMatrix());
+void MyWindow::drawTeapotPatches()
+{
+    // Same object records and instance runs as the scene's teapot commands
+    mState.useProgram(mTessProgram->programId());
+    mState.setSubroutine(GL_FRAGMENT_SHADER, tessPass1Index);
+    {
+        mScene.bindObjects();
+        if (mScene.isGpuCulling()) {
+            // Instance counts only known to the GPU: one patch command per teapot level
+            for (int level = 0; level < mScene.getLevelCount(mMeshTeapot); level++)
+                mTeapotPatches.drawIndirect(mScene.getDrawIndexBuffer(), mScene.getPatchCommandBuffer(),
+                                            mScene.getBucket(mMeshTeapot, level) * sizeof(DrawArraysIndirectCommand));
+        } else {
+            for (int i = 0; i < mScene.getCommandCount(); i++) {
+                if (mScene.getCommandMesh(i) != mMeshTeapot) continue;
+
+                const DrawElementsIndirectCommand& command = mScene.getCommand(i);
+                mTeapotPatches.draw(mScene.getDrawIndexBuffer(), command.baseInstance, command.instanceCount);
+            }
+        }
+    }
+    mState.invalidate(GLStateCache::VertexArrayState);
+}
 
-        mProgram->setUniformValue("Material.Kd", 0.9f, 0.5f, 0.3f);
-        mProgram->setUniformValue("Material.Ks", 0.95f, 0.95f, 0.95f);
-        mProgram->setUniformValue("Material.Ka", 0.9f * 0.3f, 0.5f * 0.3f, 0.3f * 0.3f);
-        mProgram->setUniformValue("Material.Shininess", 100.0f);       
+void MyWindow::setGpuTessellation(bool enabled)
+{
+    mGuiState.teapotTessellation = enabled;
+}
 
-        mProgram->setUniformValue("Width",  (float)this->width());
-        mProgram->setUniformValue("Height", (float)this->height());
-        mProgram->setUniformValue("Radius", (float)this->width() / 2.8f);
+void MyWindow::setGpuCulling(bool enabled)
+{
+    mGuiState.gpuCulling = enabled;
+}
 
-        glDrawElements(GL_TRIANGLES, 6 * mTeapot->getnFaces(), GL_UNSIGNED_INT, ((GLubyte *)NULL + (0)));
+QString MyWindow::cullingName() const
+{
+    if (!mScene.isGpuCulling())
+        return FrustumCuller::getPathName();
+    return mScene.hasDrawCount() ? "gpu_draw_count" : "gpu";
+}
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-    }
-    mProgram->release();
+void MyWindow::pass2()
+{
+    // pass1 left its grey clear colour behind; pixels outside the lenses keep this one
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-    // *** Draw plane
-    mFuncs->glBindVertexArray(mVAOPlane);
+    if (mGoggleDirty)
+        bakeGoggle();
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+    // The overlay painter may have replaced the texture bindings
+    mState.bindTexture(0, mRenderTex);
+    mState.bindTexture(2, mGoggleTex);
 
-    mProgram->bind();
+    mState.useProgram(mProgram->programId());
     {
-        mFuncs->glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &pass1Index);
+        mState.setSubroutine(GL_VERTEX_SHADER,   transformQuadIndex);
+        mState.setSubroutine(GL_FRAGMENT_SHADER, lensMaskIndex);
 
-        mProgram->setUniformValue("Light.Position",  worldLight );
-        mProgram->setUniformValue("Light.Intensity", QVector3D(1.0f, 1.0f, 1.0f));
+        // Lens outlines into the stencil only. The window's stencil does not survive the
+        // swap, so it is written every frame; two fans cost next to nothing.
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
 
-        QMatrix4x4 mv1 = ViewMatrix * ModelMatrixPlane;
-        mProgram->setUniformValue("ModelViewMatrix", mv1);
-        mProgram->setUniformValue("NormalMatrix", mv1.normalMatrix());
-        mProgram->setUniformValue("MVP", ProjectionMatrix * mv1);
+        mState.bindVertexArray(mVAOLens);
+        glDrawArrays(GL_TRIANGLE_FAN, 0,                LensSegments + 2);
+        glDrawArrays(GL_TRIANGLE_FAN, LensSegments + 2, LensSegments + 2);
 
-        mProgram->setUniformValue("Worldlight",       worldLight);
-        mProgram->setUniformValue("ViewNormalMatrix", ViewMatrix.normalMatrix());
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
 
-        mProgram->setUniformValue("Material.Kd", 0.7f, 0.7f, 0.7f);
-        mProgram->setUniformValue("Material.Ks", 0.9f, 0.9f, 0.9f);
-        mProgram->setUniformValue("Material.Ka", 0.2f, 0.2f, 0.2f);
-        mProgram->setUniformValue("Material.Shininess", 180.0f);
+        // Pixels outside the lenses fail the stencil test before the fragment shader runs
+        glStencilFunc(GL_EQUAL, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        mState.setSubroutine(GL_FRAGMENT_SHADER, pass2Index);
 
-        mProgram->setUniformValue("Width",  (float)this->width());
-        mProgram->setUniformValue("Height", (float)this->height());
-        mProgram->setUniformValue("Radius", (float)this->width() / 2.8f);
+        // Render the full-screen quad
+        mState.bindVertexArray(mVAOFSQuad);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
 
-        glDrawElements(GL_TRIANGLES, 6 * mPlane->getnFaces(), GL_UNSIGNED_INT, ((GLubyte *)NULL + (0)));
+        glDisable(GL_STENCIL_TEST);
+    }
+}
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
+void MyWindow::pass2Compute()
+{
+    // Tiles outside both lenses are never written: black since the last clear
+    if (mPostClear) {
+        mState.bindFramebuffer(GL_FRAMEBUFFER, mPostFBO);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        mState.bindFramebuffer(GL_FRAMEBUFFER, mDefaultFBO);
+        mPostClear = false;
     }
-    mProgram->release();
 
-    // *** Draw torus
-    mFuncs->glBindVertexArray(mVAOTorus);
+    if (mGoggleDirty)
+        bakeGoggle();
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+    mState.bindTexture(0, mRenderTex);
+    mState.bindTexture(2, mGoggleTex);
 
-    mProgram->bind();
+    mState.useProgram(mPass2Program->programId());
     {
-        mFuncs->glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &pass1Index);
+        mFuncs->glBindImageTexture(0, mPostTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        mFuncs->glDispatchCompute((mPostWidth + 15) / 16, (mPostHeight + 15) / 16, 1);
+        mFuncs->glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+    }
 
-        mProgram->setUniformValue("Light.Position",  worldLight );
-        mProgram->setUniformValue("Light.Intensity", QVector3D(1.0f, 1.0f, 1.0f));
+    // Straight to the window, no quad
+    mState.bindFramebuffer(GL_READ_FRAMEBUFFER, mPostFBO);
+    mState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, mDefaultFBO);
+    mFuncs->glBlitFramebuffer(0, 0, mPostWidth, mPostHeight, 0, 0, mPostWidth, mPostHeight,
+                              GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    mState.bindFramebuffer(GL_FRAMEBUFFER, mDefaultFBO);
+}
 
-        QMatrix4x4 mv1 = ViewMatrix * ModelMatrixTorus;
-        mProgram->setUniformValue("ModelViewMatrix", mv1);
-        mProgram->setUniformValue("NormalMatrix", mv1.normalMatrix());
-        mProgram->setUniformValue("MVP", ProjectionMatrix * mv1);
-        mProgram->setUniformValue("Worldlight",       worldLight);
-        mProgram->setUniformValue("ViewNormalMatrix", ViewMatrix.normalMatrix());
+void MyWindow::initGoggle()
+{
+    mGoggleProgram = loadComputeProgram(":/goggleshader.txt", "goggle");
 
-        mProgram->setUniformValue("Material.Kd", 0.9f, 0.5f, 0.3f);
-        mProgram->setUniformValue("Material.Ks", 0.95f, 0.95f, 0.95f);
-        mProgram->setUniformValue("Material.Ka", 0.9f * 0.3f, 0.5f * 0.3f, 0.3f * 0.3f);
-        mProgram->setUniformValue("Material.Shininess", 100.0f);
+    // Two triangle fans, rebuilt by bakeGoggle()
+    glGenBuffers(1, &mLensBuffer);
+    mFuncs->glGenVertexArrays(1, &mVAOLens);
+    mFuncs->glBindVertexArray(mVAOLens);
+    mFuncs->glBindVertexBuffer(0, mLensBuffer, 0, sizeof(GLfloat) * 3);
+    mFuncs->glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+    mFuncs->glVertexAttribBinding(0, 0);
+    glEnableVertexAttribArray(0);
+    mFuncs->glBindVertexArray(0);
+}
 
-        mProgram->setUniformValue("Width",  (float)this->width());
-        mProgram->setUniformValue("Height", (float)this->height());
-        mProgram->setUniformValue("Radius", (float)this->width() / 2.8f);
+float MyWindow::lensRadius(int width)
+{
+    return (float)width / 2.8f;
+}
 
-        glDrawElements(GL_TRIANGLES, 6 * mTorus->getnFaces(), GL_UNSIGNED_INT, ((GLubyte *)NULL + (0)));
+void MyWindow::bakeGoggle()
+{
+    int w = mWidth;
+    int h = mHeight;
+
+    if (mGoggleTex == 0 || w != mGoggleWidth || h != mGoggleHeight) {
+        // The new name may well be the deleted one
+        if (mGoggleTex != 0) glDeleteTextures(1, &mGoggleTex);
+        mState.invalidate(GLStateCache::TextureState);
+
+        glGenTextures(1, &mGoggleTex);
+        mState.bindTexture(2, mGoggleTex);
+        mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, w, h);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        mGoggleWidth  = w;
+        mGoggleHeight = h;
+    }
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
+    // Lens outlines in clip space, circumscribed so that the fans cover the whole circle:
+    // the exact edge comes from the texture
+    float radius = lensRadius(mWidth) / cosf((float)M_PI / LensSegments);
+    QVector<GLfloat> fans;
+    fans.reserve(2 * (LensSegments + 2) * 3);
+    for (int lens = 0; lens < 2; lens++) {
+        float centerX = lens == 0 ? -0.5f : 0.5f;
+        fans << centerX << 0.0f << 0.0f;
+        for (int i = 0; i <= LensSegments; i++) {
+            float a = TwoPI * i / LensSegments;
+            fans << centerX + 2.0f * radius * cosf(a) / w << 2.0f * radius * sinf(a) / h << 0.0f;
+        }
     }
-    mProgram->release();
+    glBindBuffer(GL_ARRAY_BUFFER, mLensBuffer);
+    glBufferData(GL_ARRAY_BUFFER, fans.size() * sizeof(GLfloat), fans.constData(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (mGoggleProgram != 0) {
+        mState.bindTexture(1, mNoiseTex != 0 ? mNoiseTex : mNoisePlaceholder);
+
+        mState.useProgram(mGoggleProgram->programId());
+        {
+            mFuncs->glBindImageTexture(0, mGoggleTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+            mFuncs->glDispatchCompute((w + 15) / 16, (h + 15) / 16, 1);
+            mFuncs->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+    }
+
+    mGoggleDirty = false;
 }
 
-void MyWindow::pass2()
+void MyWindow::initUniformBuffers()
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Materials never change: one static buffer holding the whole Materials array
+    MaterialBlock materials[MaxMaterials];
+    memset(materials, 0, sizeof(materials));
+    for (int i = 0; i < MaterialCount; i++)
+        materials[i] = MaterialTable[i];
+
+    glGenBuffers(1, &mMaterialUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, mMaterialUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(materials), materials, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    mFuncs->glBindBufferBase(GL_UNIFORM_BUFFER, MaterialBinding, mMaterialUBO);
+
+    // Frame and camera blocks, once per frame
+    mUniformRing.initialize(mContext, mFuncs, 4 * 1024);
+
+    GLint vertexStorageBlocks = 0;
+    glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexStorageBlocks);
+    if (vertexStorageBlocks < 1)
+        qWarning( "Shader storage blocks are not available in vertex shaders" );
+}
 
-    mFuncs->glBindVertexArray(mVAOFSQuad);
+void MyWindow::initScene()
+{
+    mScene.initialize(mFuncs, &mArena);
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(2);
+    QVector<float> minPixelRadius;
+    for (int i = 0; i < LodLevels; i++)
+        minPixelRadius << LodPixelRadius[i];
 
-    mProgram->bind();
-    {
-        mProgram->setUniformValue("EdgeThreshold", 0.1f);
+    mMeshTeapot = mScene.addMesh(mTeapotLevels, minPixelRadius, mTeapotSphere);
+    mMeshTorus  = mScene.addMesh(mTorusLevels,  minPixelRadius, mTorusSphere);
+    mMeshPlane  = mScene.addMesh(mPlaneLevel, mPlaneSphere);
+    mScene.setPatchVertices(mMeshTeapot, mTeapotPatches.getPatchCount() * TeapotPatches::PatchVertices);
+    mScene.setCullProgram(mCullProgram);
 
-        mFuncs->glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &pass2Index);
+    buildScene(0);
+}
 
-        QMatrix4x4 mv1 ,proj;
+void MyWindow::buildScene(int stressCount)
+{
+    mScene.clear();
+    StressCount = stressCount;
 
-        mProgram->setUniformValue("ModelViewMatrix", mv1);
-        mProgram->setUniformValue("NormalMatrix", mv1.normalMatrix());
-        mProgram->setUniformValue("MVP", proj * mv1);
+    // Consecutive objects sharing a mesh are drawn by the same indirect command
+    mScene.addObject(mMeshPlane, MaterialGrey, ModelMatrixPlane);
 
-        // Render the full-screen quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    if (stressCount == 0) {
+        mScene.addObject(mMeshTeapot, MaterialCopper, ModelMatrixTeapot);
+        mScene.addObject(mMeshTorus,  MaterialCopper, ModelMatrixTorus);
+        return;
+    }
+
+    // Stress mode: stressCount teapots then stressCount tori, on a grid centered on the
+    // origin or scattered over the same area
+    const float spacing = 3.0f;
+    int   side   = (int)ceil(sqrt((double)stressCount));
+    float extent = 0.5f * spacing * (side - 1);
+
+    const int materials[3] = { MaterialCopper, MaterialJade, MaterialPewter };
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> heading(0.0f, 360.0f);
+
+    for (int mesh = 0; mesh < 2; mesh++) {
+        for (int i = 0; i < stressCount; i++) {
+            float x, z;
+            if (StressRandom) {
+                x = position(random);
+                z = position(random);
+            } else {
+                x = spacing * (i % side) - extent;
+                z = spacing * (i / side) - extent;
+            }
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(2);
+            QMatrix4x4 model;
+            if (mesh == 0) {
+                model.translate(x, 0.0f, z);
+                model.rotate(heading(random), QVector3D(0.0f, 1.0f, 0.0f));
+                model *= ModelMatrixTeapot;
+                mScene.addObject(mMeshTeapot, materials[i % 3], model);
+            } else {
+                // Tori float in the gaps between teapots
+                model.translate(x + 0.5f * spacing, 1.0f, z + 0.5f * spacing);
+                model.rotate(heading(random), QVector3D(0.0f, 1.0f, 0.0f));
+                model.rotate(90.0f, QVector3D(1.0f, 0.0f, 0.0f));
+                mScene.addObject(mMeshTorus, materials[(i + 1) % 3], model);
+            }
+        }
     }
-    mProgram->release();
 
-    mContext->swapBuffers(this);
+    qDebug() << "stress scene:" << mScene.getObjectCount() << "objects";
+}
+
+void MyWindow::prepareFrame(FrameSnapshot& frame)
+{
+    frame.projection.setToIdentity();
+    frame.projection.perspective(60.0f, (float)frame.width/(float)qMax(frame.height, 1), 0.3f, 100.0f);
+    frame.viewProjection = frame.projection * frame.view;
+
+    QVector4D worldLight = QVector4D(0.0f, 0.0f, 0.0f, 1.0f);
+
+    storeVec4(frame.frameBlock.lightPosition,  worldLight);
+    storeVec4(frame.frameBlock.lightIntensity, QVector4D(1.0f, 1.0f, 1.0f, 0.0f));
+    frame.frameBlock.width         = (float)frame.width;
+    frame.frameBlock.height        = (float)frame.height;
+    frame.frameBlock.radius        = lensRadius(frame.width);
+    frame.frameBlock.edgeThreshold = 0.1f;
+
+    storeMat4(frame.cameraBlock.view,       frame.view);
+    storeMat4(frame.cameraBlock.projection, frame.projection);
+    storeMat3(frame.cameraBlock.viewNormal, frame.view.normalMatrix());
+}
+
+void MyWindow::updateFrameUniforms()
+{
+    // Levels are picked for the pixels they are rendered at
+    mScene.setCamera(ViewMatrix, ProjectionMatrix, NightVision ? mRenderHeight : mHeight);
+
+    // Waits only when the GPU is more frames behind than the ring allows
+    mUniformRing.beginFrame();
+    GLintptr frameOffset  = mUniformRing.push(&mApplied.frameBlock,  sizeof(FrameBlock));
+    GLintptr cameraOffset = mUniformRing.push(&mApplied.cameraBlock, sizeof(CameraBlock));
+    mUniformRing.flush();
+    mUniformRing.bindRange(FrameBinding,  frameOffset,  sizeof(FrameBlock));
+    mUniformRing.bindRange(CameraBinding, cameraOffset, sizeof(CameraBlock));
 }
 
 void MyWindow::initShaders()
@@ -488,6 +1241,61 @@ void MyWindow::initShaders()
     qDebug() << "shader link: " << mProgram->link();
 }
 
+void MyWindow::initTessellationShaders()
+{
+    QOpenGLShader vShader (QOpenGLShader::Vertex);
+    QOpenGLShader tcShader(QOpenGLShader::TessellationControl);
+    QOpenGLShader teShader(QOpenGLShader::TessellationEvaluation);
+    QOpenGLShader fShader (QOpenGLShader::Fragment);
+    QFile         shaderFile;
+    QByteArray    shaderSource;
+
+    // Bezier patches of the teapot, lit by the pass1 subroutine of the usual fragment shader
+    shaderFile.setFileName(":/teapotvshader.txt");
+    shaderFile.open(QIODevice::ReadOnly);
+    shaderSource = shaderFile.readAll();
+    shaderFile.close();
+    qDebug() << "patch vertex compile: " << vShader.compileSourceCode(shaderSource);
+
+    shaderFile.setFileName(":/teapottcshader.txt");
+    shaderFile.open(QIODevice::ReadOnly);
+    shaderSource = shaderFile.readAll();
+    shaderFile.close();
+    qDebug() << "patch control compile: " << tcShader.compileSourceCode(shaderSource);
+
+    shaderFile.setFileName(":/teapottesshader.txt");
+    shaderFile.open(QIODevice::ReadOnly);
+    shaderSource = shaderFile.readAll();
+    shaderFile.close();
+    qDebug() << "patch evaluation compile: " << teShader.compileSourceCode(shaderSource);
+
+    shaderFile.setFileName(":/fshader.txt");
+    shaderFile.open(QIODevice::ReadOnly);
+    shaderSource = shaderFile.readAll();
+    shaderFile.close();
+    qDebug() << "patch frag compile: " << fShader.compileSourceCode(shaderSource);
+
+    mTessProgram = new (QOpenGLShaderProgram);
+    mTessProgram->addShader(&vShader);
+    mTessProgram->addShader(&tcShader);
+    mTessProgram->addShader(&teShader);
+    mTessProgram->addShader(&fShader);
+    qDebug() << "patch shader link: " << mTessProgram->link();
+
+    tessPass1Index = mFuncs->glGetSubroutineIndex( mTessProgram->programId(), GL_FRAGMENT_SHADER, "pass1");
+
+    // The object records hold the model matrices of the quantized arena teapot
+    const MeshBounds& bounds = mArena.getMesh(mTeapotLevels.first()).bounds;
+    mTessProgram->bind();
+    mTessProgram->setUniformValue("MeshCenter", QVector3D(bounds.center[0], bounds.center[1], bounds.center[2]));
+    mTessProgram->setUniformValue("MeshExtent", QVector3D(bounds.extent[0], bounds.extent[1], bounds.extent[2]));
+    mTessProgram->setUniformValue("PixelsPerSegment", 8.0f);
+    mTessProgram->release();
+
+    qDebug() << "teapot patches:" << mTeapotPatches.getPatchCount() << "patches,"
+             << mTeapotPatches.getByteCount() << "bytes of control points";
+}
+
 void MyWindow::PrepareTexture(GLenum TextureTarget, const QString& FileName, GLuint& TexObject, bool flip)
 {
     QImage TexImg;
@@ -502,35 +1310,98 @@ void MyWindow::PrepareTexture(GLenum TextureTarget, const QString& FileName, GLu
     glTexParameterf(TextureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
+QOpenGLShaderProgram *MyWindow::loadComputeProgram(const QString& fileName, const char *name)
+{
+    QOpenGLShader cShader(QOpenGLShader::Compute);
+    QFile         shaderFile;
+    QByteArray    shaderSource;
+
+    shaderFile.setFileName(fileName);
+    shaderFile.open(QIODevice::ReadOnly);
+    shaderSource = shaderFile.readAll();
+    shaderFile.close();
+    qDebug() << name << "compute compile: " << cShader.compileSourceCode(shaderSource);
+
+    QOpenGLShaderProgram *program = new (QOpenGLShaderProgram);
+    program->addShader(&cShader);
+    if (!program->link()) {
+        qWarning() << name << "shader link failed:" << program->log();
+        delete program;
+        return 0;
+    }
+    return program;
+}
+
+void MyWindow::initCullShader()
+{
+    // Frustum culling and level selection of the scene objects, see Scene::cullOnGpu().
+    // Without it culling stays on the CPU.
+    mCullProgram = loadComputeProgram(":/cullshader.txt", "cull");
+}
+
+void MyWindow::initHiZShader()
+{
+    // Depth pyramid of pass1 for the occlusion test of the GPU culling
+    mHiZProgram = loadComputeProgram(":/hizshader.txt", "hiz");
+    mHiZ.initialize(mFuncs, mHiZProgram);
+}
+
 void MyWindow::keyPressEvent(QKeyEvent *keyEvent)
 {
     switch(keyEvent->key())
     {
         case Qt::Key_P:
+            mGuiState.showOverlay = ! mGuiState.showOverlay;
             break;
         case Qt::Key_Up:
+            mGuiState.stressCount = mGuiState.stressCount == 0 ? 64 : qMin(2 * mGuiState.stressCount, (int)MaxStressCount);
             break;
         case Qt::Key_Down:
+            mGuiState.stressCount = mGuiState.stressCount <= 64 ? 0 : mGuiState.stressCount / 2;
             break;
         case Qt::Key_Left:
+            mScheduler.setMode((FrameScheduler::Mode)((mScheduler.getMode() + 1) % FrameScheduler::ModeCount));
             break;
         case Qt::Key_Right:
+            cycleRenderScale();
             break;
         case Qt::Key_Delete:
             break;
         case Qt::Key_PageDown:
             break;
         case Qt::Key_Home:
+            mGuiState.stressRandom = ! mGuiState.stressRandom;
             break;
         case Qt::Key_S:
             SpringAnimate = ! SpringAnimate;
             break;
         case Qt::Key_N:
-            NightVision = ! NightVision;
+            mGuiState.nightVision = ! mGuiState.nightVision;
+            break;
+        case Qt::Key_G:
+            NoiseAnimate = ! NoiseAnimate;
+            break;
+        case Qt::Key_L:
+            mGuiState.profileLog = ! mGuiState.profileLog;
+            if (mGuiState.profileLog && !mHeadless)
+                mActivityTimer.start(1000);
+            else
+                mActivityTimer.stop();
             break;
         case Qt::Key_B:
+            mGuiState.teapotTessellation = ! mGuiState.teapotTessellation;
+            break;
+        case Qt::Key_C:
+            mGuiState.gpuCulling = ! mGuiState.gpuCulling;
+            break;
+        case Qt::Key_O:
+            mGuiState.occlusionCulling = ! mGuiState.occlusionCulling;
+            break;
+        case Qt::Key_T:
+            mGuiState.computePass2 = ! mGuiState.computePass2;
             break;
         case Qt::Key_D:
+            OnDemand = ! OnDemand;
             break;
         case Qt::Key_A:
             break;
@@ -539,6 +1410,9 @@ void MyWindow::keyPressEvent(QKeyEvent *keyEvent)
         default:
             break;
     }
+
+    // Every key may change what is on screen
+    damage();
 }
 
 void MyWindow::printMatrix(const QMatrix4x4& mat)
@@ -552,96 +1426,252 @@ void MyWindow::printMatrix(const QMatrix4x4& mat)
 }
 
 void MyWindow::setupFBO() {
-    // Generate and bind the framebuffer
+    // Generate the framebuffer, its targets follow the render scale
     glGenFramebuffers(1, &mFBOHandle);
-    glBindFramebuffer(GL_FRAMEBUFFER, mFBOHandle);
+    resizeRenderTarget();
 
-    // Create the texture object
-    GLuint renderTex;
-    glGenTextures(1, &renderTex);
-    glActiveTexture(GL_TEXTURE0);  // Use texture unit 0
-    glBindTexture(GL_TEXTURE_2D, renderTex);
-    mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, this->width(), this->height());
+    // Target of the compute pass2, blitted to the window; follows the window size
+    glGenFramebuffers(1, &mPostFBO);
+    resizePostTarget();
+
+    // Unbind the framebuffer, and revert to default framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void MyWindow::resizePostTarget()
+{
+    mPostWidth  = mWidth;
+    mPostHeight = mHeight;
+
+    // Immutable storage: a new texture for every size
+    if (mPostTex != 0) glDeleteTextures(1, &mPostTex);
+
+    glGenTextures(1, &mPostTex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, mPostTex);
+    mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, mPostWidth, mPostHeight);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, mRenderTex);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mPostFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mPostTex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, mDefaultFBO);
+
+    // The tiles outside the lenses are only cleared, see pass2Compute()
+    mPostClear = true;
+}
+
+void MyWindow::resizeRenderTarget()
+{
+    QSize size = renderSize();
+    mRenderWidth  = size.width();
+    mRenderHeight = size.height();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mFBOHandle);
+
+    // Immutable storage: new textures for every size
+    if (mRenderTex != 0) glDeleteTextures(1, &mRenderTex);
+    if (mDepthTex  != 0) glDeleteTextures(1, &mDepthTex);
+
+    // Create the texture object, filtered when pass2 upscales it
+    glGenTextures(1, &mRenderTex);
+    glActiveTexture(GL_TEXTURE0);  // Use texture unit 0
+    glBindTexture(GL_TEXTURE_2D, mRenderTex);
+    mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, mRenderWidth, mRenderHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     GL_CLAMP_TO_EDGE);
 
     // Bind the texture to the FBO
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, renderTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mRenderTex, 0);
 
-    // Create the depth buffer
-    GLuint depthBuf;
-    glGenRenderbuffers(1, &depthBuf);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthBuf);
-    mFuncs->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, this->width(), this->height());
+    // Create the depth texture, sampled to build the depth pyramid
+    glGenTextures(1, &mDepthTex);
+    glBindTexture(GL_TEXTURE_2D, mDepthTex);
+    mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, mRenderWidth, mRenderHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Bind the depth texture to the FBO
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepthTex, 0);
+    glBindTexture(GL_TEXTURE_2D, mRenderTex);
 
-    // Bind the depth buffer to the FBO
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                              GL_RENDERBUFFER, depthBuf);
+    mHiZ.resize(mRenderWidth, mRenderHeight);
+    // Nothing in the new pyramid until pass1 builds it: no occlusion test before that
+    mScene.setOcclusion(0, QMatrix4x4());
 
     // Set the targets for the fragment output variables
     GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0};
     mFuncs->glDrawBuffers(1, drawBuffers);
 
-    // Unbind the framebuffer, and revert to default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, mDefaultFBO);
+}
+
+float MyWindow::renderScale() const
+{
+    return DynamicScale ? mDynamicResolution.getScale() : RenderScale;
+}
+
+QSize MyWindow::renderSize() const
+{
+    return QSize(qMax(1, qRound(mWidth  * renderScale())),
+                 qMax(1, qRound(mHeight * renderScale())));
+}
+
+void MyWindow::setRenderScale(float scale)
+{
+    mGuiState.renderScale  = qBound(0.25f, scale, 1.0f);
+    mGuiState.dynamicScale = false;
+}
+
+void MyWindow::setDynamicResolution(bool enabled)
+{
+    // Starts from the fixed scale, the target follows in a few cooldowns
+    mGuiState.dynamicScale = enabled;
+}
+
+void MyWindow::cycleRenderScale()
+{
+    // Presets from full to lowest, then dynamic, then full again
+    if (mGuiState.dynamicScale) {
+        setRenderScale(RenderScalePresets[0]);
+        return;
+    }
+
+    int preset = 0;
+    while (preset < RenderScalePresetCount && !qFuzzyCompare(RenderScalePresets[preset], mGuiState.renderScale))
+        preset++;
+
+    if (preset + 1 < RenderScalePresetCount)
+        setRenderScale(RenderScalePresets[preset + 1]);
+    else
+        setDynamicResolution(true);
 }
 
 void MyWindow::GenerateTexture(float baseFreq, float persistence, int w, int h, bool periodic)
 {
-    int width = w;
-    int height = h;
+    // GUI thread. A cache hit goes with the next snapshot, pointing into the file mapping;
+    // otherwise the texture is built in the background while the placeholder stays bound
+    QSharedPointer<NoiseCache> cache(new NoiseCache(baseFreq, persistence, w, h, periodic));
+    const GLubyte *data = cache->map();
+
+    NoiseRequest request;
+    request.baseFreq    = baseFreq;
+    request.persistence = persistence;
+    request.w           = w;
+    request.h           = h;
+    request.periodic    = periodic;
+    request.offsetX     = 0.0f;
+    request.offsetY     = 0.0f;
+    request.cached      = true;
+
+    if (data == 0) {
+        startNoiseJob(request);
+        return;
+    }
 
-    printf("Generating noise texture...");
+    mNoiseInFlight     = request;
+    mNoiseReady        = QByteArray::fromRawData((const char *)data, w * h * 4);
+    mNoiseMapping      = cache;
+    mNoiseReadyPending = true;
+}
 
-    GLubyte *data = new GLubyte[ width * height * 4 ];
+void MyWindow::createNoisePlaceholder()
+{
+    // Single mid-grey texel: neutral grain until the real noise is available
+    const GLubyte texel[4] = { 192, 192, 192, 192 };
 
-    float xFactor = 1.0f / (width - 1);
-    float yFactor = 1.0f / (height - 1);
+    glActiveTexture(GL_TEXTURE1);
+    glGenTextures(1, &mNoisePlaceholder);
+    glBindTexture(GL_TEXTURE_2D, mNoisePlaceholder);
+    mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+    mFuncs->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     GL_REPEAT);
 
-    for( int row = 0; row < height; row++ ) {
-        for( int col = 0 ; col < width; col++ ) {
-            float x = xFactor * col;
-            float y = yFactor * row;
-            float sum = 0.0f;
-            float freq = baseFreq;
-            float persist = persistence;
-            for( int oct = 0; oct < 4; oct++ ) {
-                glm::vec2 p(x * freq, y * freq);
+    glGenBuffers(1, &mNoisePBO);
 
-                float val = 0.0f;
-                if (periodic) {
-                  val = glm::perlin(p, glm::vec2(freq)) * persist;
-                } else {
-                  val = glm::perlin(p) * persist;
-                }
+    qDebug() << "noise generator:" << NoiseGenerator::getPathName();
+}
 
-                sum += val;
+void MyWindow::startNoiseJob(const NoiseRequest& request)
+{
+    if (mNoiseWatcher.isRunning()) return;
 
-                float result = (sum + 1.0f) / 2.0f;
+    mNoiseInFlight = request;
+    mNoiseWatcher.setFuture(QtConcurrent::run([request]() -> QByteArray {
+        NoiseGenerator generator(request.baseFreq, request.persistence, request.w, request.h, request.periodic);
+        generator.setOffset(request.offsetX, request.offsetY);
 
-                // Clamp strictly between 0 and 1
-                result = result > 1.0f ? 1.0f : result;
-                result = result < 0.0f ? 0.0f : result;
+        QByteArray texels(generator.getByteCount(), Qt::Uninitialized);
+        generator.generate(reinterpret_cast<unsigned char *>(texels.data()));
 
-                // Store in texture
-                data[((row * width + col) * 4) + oct] = (GLubyte) ( result * 255.0f );
-                freq *= 2.0f;
-                persist *= persistence;
-            }
+        if (request.cached) {
+            NoiseCache cache(request.baseFreq, request.persistence, request.w, request.h, request.periodic);
+            cache.store(reinterpret_cast<const unsigned char *>(texels.constData()), texels.size());
         }
+        return texels;
+    }));
+}
+
+void MyWindow::noiseGenerated()
+{
+    mNoiseReady        = mNoiseWatcher.result();
+    mNoiseMapping.clear();
+    mNoiseReadyPending = true;
+
+    // Noise animation ticks at the pace of the background job
+    damage();
+}
+
+void MyWindow::uploadNoise(const QByteArray& texels, int w, int h, bool mapped)
+{
+    // Straight from the file mapping: the driver copies client memory before returning
+    if (mapped) {
+        allocateNoiseTexture(w, h);
+        mFuncs->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, texels.constData());
+        mGoggleDirty = true;
+        return;
     }
 
+    // Orphan the PBO so that a previous upload still in flight is never waited on
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mNoisePBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, texels.size(), NULL, GL_STREAM_DRAW);
+    void *dst = mFuncs->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, texels.size(),
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst != 0) {
+        memcpy(dst, texels.constData(), texels.size());
+        mFuncs->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        allocateNoiseTexture(w, h);
+        mFuncs->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, ((GLubyte *)NULL + (0)));
+        mGoggleDirty = true;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void MyWindow::allocateNoiseTexture(int w, int h)
+{
     glActiveTexture(GL_TEXTURE1);
 
-    GLuint TexObject;
-    glGenTextures(1, &TexObject);
-    glBindTexture(GL_TEXTURE_2D, TexObject);
-    mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
-    mFuncs->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     GL_REPEAT);
+    if (mNoiseTex == 0 || w != mNoiseTexWidth || h != mNoiseTexHeight) {
+        if (mNoiseTex != 0) glDeleteTextures(1, &mNoiseTex);
 
-    delete [] data;
+        glGenTextures(1, &mNoiseTex);
+        glBindTexture(GL_TEXTURE_2D, mNoiseTex);
+        mFuncs->glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     GL_REPEAT);
+
+        mNoiseTexWidth  = w;
+        mNoiseTexHeight = h;
+    } else {
+        glBindTexture(GL_TEXTURE_2D, mNoiseTex);
+    }
 }
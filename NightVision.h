@@ -1,8 +1,15 @@
 #include <QWindow>
 #include <QTimer>
 #include <QString>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QFutureWatcher>
 #include <QKeyEvent>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QOffscreenSurface>
 
+#include <QVector>
 #include <QVector3D>
 #include <QMatrix4x4>
 
@@ -15,6 +22,18 @@
 #include "teapot.h"
 #include "vboplane.h"
 #include "torus.h"
+#include "profiler.h"
+#include "uniformblocks.h"
+#include "uniformring.h"
+#include "glstatecache.h"
+#include "geometryarena.h"
+#include "scene.h"
+#include "teapotpatches.h"
+#include "hizpyramid.h"
+#include "dynamicresolution.h"
+#include "framescheduler.h"
+#include "framesnapshot.h"
+#include "renderthread.h"
 
 #include "SpringForce/springforce.h"
 
@@ -32,29 +51,123 @@ class MyWindow : public QWindow, protected QOpenGLFunctions
     Q_OBJECT
 
 public:
-    explicit MyWindow();
+    // The frame mode picks the swap interval of the context: only Uncapped creates it
+    // without one
+    explicit MyWindow(bool headless = false, FrameScheduler::Mode frameMode = FrameScheduler::VSync);
     ~MyWindow();
     virtual void keyPressEvent( QKeyEvent *keyEvent );    
 
+    // Renders frames offscreen back to back, normal then night vision, and reports timings
+    // stressCount > 0 replaces the scene with that many teapots and tori; with sweep, every
+    // power of two up to stressCount is measured
+    QJsonObject runBenchmark(int frames, float timestep, int stressCount = 0, bool sweep = false);
+
+    static const int MaxStressCount = 65536;
+
+    // Draws the teapot from its Bezier patches with the tessellation shaders instead of
+    // the CPU tessellated mesh
+    void setGpuTessellation(bool enabled);
+
+    // Culls and selects the levels in a compute shader instead of on the CPU
+    void setGpuCulling(bool enabled);
+
+    // Night vision renders pass1 at this fraction of the window and upscales it in pass2;
+    // with dynamic resolution the scale follows the GPU time instead
+    void setRenderScale(float scale);
+    void setDynamicResolution(bool enabled);
+
+    // Rate of FrameScheduler::FixedRate
+    void setFixedFrameRate(double framesPerSecond);
+
+    // Renders only when something changed: input, resize, exposure, the spring animation
+    // or new noise. The last frame stays on screen in between.
+    void setRenderOnDemand(bool enabled);
+
 private slots:
     void render();
+    void frameDone();
+    void noiseGenerated();
+    void logActivity();
 
 private:    
     void initialize();
-    void modCurTime();
+    void damage();
+
+    // GUI thread: the state of the next frame. Render thread (or the benchmark): draws it.
+    FrameSnapshot makeSnapshot(double time);
+    static void prepareFrame(FrameSnapshot& frame);
+    void renderSnapshot(const FrameSnapshot& frame);
+    void applySnapshot(const FrameSnapshot& frame);
+
+    void renderFrame();
+    void present();
+    void drawOverlay();
+    QString    levelSummary(int mesh) const;
+    QJsonArray levelObjects(int mesh) const;
+    QString    cullingName() const;
+
+    QSurface *renderSurface();
+    void createHeadlessTarget();
+    QJsonObject benchmarkScene(int frames, float timestep);
+    // threaded: the frames are drawn on a RenderThread while this thread makes the next ones
+    QJsonObject benchmarkMode(bool nightVision, int frames, float timestep, bool threaded = false);
 
     void initShaders();
+    void initTessellationShaders();
+    void initCullShader();
+    void initHiZShader();
+    QOpenGLShaderProgram *loadComputeProgram(const QString& fileName, const char *name);
     void CreateVertexBuffer();    
     void initMatrices();
     void setupFBO();
+    void resizeRenderTarget();
+    void resizePostTarget();
+    float renderScale() const;
+    QSize renderSize() const;
+    void cycleRenderScale();
 
     void pass1();
+    void drawTeapotPatches();
     void pass2();
+    void pass2Compute();
+    void initGoggle();
+    void bakeGoggle();
+    static float lensRadius(int width);
+
+    enum MaterialId
+    {
+        MaterialCopper,
+        MaterialGrey,
+        MaterialJade,
+        MaterialPewter,
+        MaterialCount
+    };
+
+    void initUniformBuffers();
+    void initScene();
+    void buildScene(int stressCount);
+    void updateFrameUniforms();
 
     void PrepareTexture(GLenum TextureTarget, const QString& FileName, GLuint& TexObject, bool flip);
     void GenerateTexture(float baseFreq, float persistence, int w, int h, bool periodic);
 
+    struct NoiseRequest
+    {
+        float baseFreq, persistence;
+        int   w, h;
+        bool  periodic;
+        float offsetX, offsetY;
+        bool  cached;
+    };
+
+    void createNoisePlaceholder();
+    void startNoiseJob(const NoiseRequest& request);
+    void uploadNoise(const QByteArray& texels, int w, int h, bool mapped);
+    void allocateNoiseTexture(int w, int h);
+
 protected:
+    bool event(QEvent *event);
+    void exposeEvent(QExposeEvent *);
     void resizeEvent(QResizeEvent *);
 
 private:
@@ -62,29 +175,110 @@ private:
     QOpenGLFunctions_4_3_Core *mFuncs;
 
     QOpenGLShaderProgram *mProgram;
+    QOpenGLShaderProgram *mTessProgram;
+    QOpenGLShaderProgram *mCullProgram;
+    QOpenGLShaderProgram *mHiZProgram;
+    QOpenGLShaderProgram *mPass2Program;
+    QOpenGLShaderProgram *mGoggleProgram;
 
-    QTimer mRepaintTimer;
-    double currentTimeMs;
     double currentTimeS;
     bool   mUpdateSize;
     float  tPrev, angle;
 
-    GLuint mVAOTeapot, mVAOPlane, mVAOTorus, mVAOFSQuad, mVBO, mIBO, mFBOHandle;
+    FrameScheduler mScheduler;
+    QTimer         mActivityTimer;  // logs the wake-ups while the profile log is on
+
+    // Frames still owed after a change, until the latent state (occlusion against the
+    // previous frame, GPU statistics) has caught up
+    static const int SettleFrames = Scene::StatsLatency + 1;
+    int mDamageFrames;
+
+    // Windows draw on their own thread, which owns mContext once started. Input only
+    // changes mGuiState; the renderer's copies of the toggles below, and everything GL,
+    // only change when a snapshot is applied.
+    RenderThread *mRenderThread;
+    FrameSnapshot mGuiState;
+    FrameSnapshot mApplied;         // last snapshot applied, to see what changed
+    int           mWidth, mHeight;  // of the applied snapshot
+
+    bool               mHeadless;
+    bool               mInitialized;
+    QOffscreenSurface *mOffscreen;
+    GLuint             mDefaultFBO;
+
+    // Samples kept by the profiler's rolling statistics
+    static const int ProfilerWindow = 240;
+
+    Profiler mProfiler;
+    int      mScopeFrame, mScopePass1, mScopePass2, mScopeScene, mScopeSwap, mScopeHiZ;
+    int      mFramesSinceLog;
+
+    GLuint mVAOFSQuad, mVBO, mIBO, mFBOHandle, mRenderTex, mDepthTex;
+    int    mRenderWidth, mRenderHeight;     // pass1 target of night vision
+    GLuint mPostFBO, mPostTex;          // compute pass2 target
+    int    mPostWidth, mPostHeight;
+    bool   mPostClear;
     GLuint mPositionBufferHandle, mColorBufferHandle;
     GLuint mRotationMatrixLocation;
 
-    GLuint pass1Index, pass2Index;
+    GLuint pass1Index, pass2Index, lensMaskIndex, transformObjectIndex, transformQuadIndex;
+    GLuint tessPass1Index;
+
+    UniformRing  mUniformRing;
+    GLuint       mMaterialUBO;
+    GLStateCache mState;            // bindings of the passes, reset every frame
+
+    GeometryArena mArena;
+    Scene         mScene;
+    QVector<int>  mTeapotLevels, mTorusLevels;     // arena meshes, coarsest first
+    int           mPlaneLevel;
+    int           mMeshTeapot, mMeshPlane, mMeshTorus;   // scene meshes
+    TeapotPatches mTeapotPatches;
+    HiZPyramid    mHiZ;             // depth of the night vision pass1
+    DynamicResolution mDynamicResolution;
 
-    Teapot   *mTeapot;
-    VBOPlane *mPlane;
-    Torus    *mTorus;
+    // Object space bounding spheres holding every level of the meshes
+    BoundingSphere mTeapotSphere, mTorusSphere, mPlaneSphere;
+
+    // Noise texture bound to unit 1: a placeholder until the background job delivers
+    GLuint mNoiseTex, mNoisePlaceholder, mNoisePBO;
+    int    mNoiseTexWidth, mNoiseTexHeight;
+
+    QFutureWatcher<QByteArray> mNoiseWatcher;
+    NoiseRequest mNoiseInFlight;
+    QByteArray   mNoiseReady;
+    QSharedPointer<NoiseCache> mNoiseMapping;   // of a cache hit, see GenerateTexture()
+    bool         mNoiseReadyPending;
+    float        mNoisePhase;
+
+    // Lens mask times noise grain, one byte per pixel, bound to unit 2 for pass2. Baked
+    // again on resize and whenever the noise changes; the lens outlines feed the stencil.
+    static const int LensSegments = 64;
+
+    GLuint mGoggleTex, mVAOLens, mLensBuffer;
+    int    mGoggleWidth, mGoggleHeight;
+    bool   mGoggleDirty;
 
     QMatrix4x4 ModelMatrixTeapot, ModelMatrixPlane, ModelMatrixTorus, ViewMatrix, ProjectionMatrix, SpringMatrix;
 
+    // GUI thread only: they decide when and with what a frame is made
     bool        SpringAnimate = false;
-    bool        NightVision   = false;
+    bool        NoiseAnimate  = false;
+    bool        OnDemand      = false;
     SpringForce aSpring;
 
+    // Renderer side, set from the snapshots
+    bool        NightVision   = false;
+    bool        ShowOverlay   = false;
+    bool        ProfileLog    = false;
+    bool        StressRandom  = false;
+    bool        TeapotTessellation = false;
+    bool        OcclusionCulling   = true;
+    bool        ComputePass2       = false;
+    bool        DynamicScale       = false;
+    float       RenderScale        = 1.0f;
+    int         StressCount   = 0;
+
     //debug
     void printMatrix(const QMatrix4x4& mat);
 };
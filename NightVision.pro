@@ -1,4 +1,4 @@
-QT += gui core
+QT += gui core concurrent
 
 CONFIG += c++11
 
@@ -15,6 +15,22 @@ SOURCES += main.cpp \
     teapot.cpp \
     vboplane.cpp \
     torus.cpp \
+    noisegenerator.cpp \
+    noisecache.cpp \
+    profiler.cpp \
+    uniformring.cpp \
+    glstatecache.cpp \
+    geometryarena.cpp \
+    scene.cpp \
+    bounds.cpp \
+    frustumculler.cpp \
+    hizpyramid.cpp \
+    dynamicresolution.cpp \
+    framescheduler.cpp \
+    renderthread.cpp \
+    teapotpatches.cpp \
+    vertexcache.cpp \
+    vertexformat.cpp \
     SpringForce\springforce.cpp
 
 HEADERS += \
@@ -23,15 +39,48 @@ HEADERS += \
     teapot.h \
     vboplane.h \
     torus.h \
+    noisegenerator.h \
+    noisecache.h \
+    profiler.h \
+    uniformblocks.h \
+    uniformring.h \
+    glstatecache.h \
+    geometryarena.h \
+    scene.h \
+    bounds.h \
+    frustumculler.h \
+    hizpyramid.h \
+    dynamicresolution.h \
+    framescheduler.h \
+    framesnapshot.h \
+    renderthread.h \
+    spscqueue.h \
+    teapotpatches.h \
+    vertexcache.h \
+    vertexformat.h \
     SpringForce\springforce.h
 
 OTHER_FILES += \
     fshader.txt \
-    vshader.txt
+    vshader.txt \
+    teapotvshader.txt \
+    teapottcshader.txt \
+    teapottesshader.txt \
+    cullshader.txt \
+    hizshader.txt \
+    pass2shader.txt \
+    goggleshader.txt
 
 RESOURCES += \
     shaders.qrc
 
 DISTFILES += \
     fshader.txt \
-    vshader.txt
+    vshader.txt \
+    teapotvshader.txt \
+    teapottcshader.txt \
+    teapottesshader.txt \
+    cullshader.txt \
+    hizshader.txt \
+    pass2shader.txt \
+    goggleshader.txt
@@ -0,0 +1,58 @@
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+BoundingBox computeBox(const float *v, int nVerts)
+{
+    BoundingBox box;
+
+    for (int c = 0; c < 3; c++) {
+        box.min[c] = nVerts > 0 ? v[c] : 0.0f;
+        box.max[c] = box.min[c];
+        for (int i = 1; i < nVerts; i++) {
+            box.min[c] = std::min(box.min[c], v[3 * i + c]);
+            box.max[c] = std::max(box.max[c], v[3 * i + c]);
+        }
+    }
+
+    return box;
+}
+
+BoundingSphere computeSphere(const float *v, int nVerts)
+{
+    BoundingBox box = computeBox(v, nVerts);
+
+    BoundingSphere sphere;
+    for (int c = 0; c < 3; c++)
+        sphere.center[c] = 0.5f * (box.min[c] + box.max[c]);
+
+    float radius2 = 0.0f;
+    for (int i = 0; i < nVerts; i++) {
+        float dx = v[3 * i]     - sphere.center[0];
+        float dy = v[3 * i + 1] - sphere.center[1];
+        float dz = v[3 * i + 2] - sphere.center[2];
+        radius2 = std::max(radius2, dx * dx + dy * dy + dz * dz);
+    }
+    sphere.radius = std::sqrt(radius2);
+
+    return sphere;
+}
+
+BoundingSphere mergeSpheres(const BoundingSphere& a, const BoundingSphere& b)
+{
+    float d[3] = { b.center[0] - a.center[0], b.center[1] - a.center[1], b.center[2] - a.center[2] };
+    float distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    // One sphere already holds the other
+    if (distance + b.radius <= a.radius) return a;
+    if (distance + a.radius <= b.radius) return b;
+
+    BoundingSphere sphere;
+    sphere.radius = 0.5f * (distance + a.radius + b.radius);
+    float t = (sphere.radius - a.radius) / distance;
+    for (int c = 0; c < 3; c++)
+        sphere.center[c] = a.center[c] + t * d[c];
+
+    return sphere;
+}
@@ -0,0 +1,24 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+// Object space bounding volumes of the generated meshes, computed when they are built
+
+struct BoundingBox
+{
+    float min[3];
+    float max[3];
+};
+
+struct BoundingSphere
+{
+    float center[3];
+    float radius;
+};
+
+BoundingBox    computeBox(const float *v, int nVerts);
+// Centered on the box, with the distance to the farthest vertex as radius
+BoundingSphere computeSphere(const float *v, int nVerts);
+// Smallest sphere holding both a and b
+BoundingSphere mergeSpheres(const BoundingSphere& a, const BoundingSphere& b);
+
+#endif // BOUNDS_H
@@ -0,0 +1,89 @@
+#include "dynamicresolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+const float DynamicResolution::Step = 0.05f;
+
+namespace
+{
+    // Weight of a new sample in the smoothed time
+    const double Smoothing = 0.1;
+
+    // Scale down above Target * Over, up below Target * Under: going up one step costs
+    // about 20% more pixels, so the band leaves room for it
+    const double Over  = 1.05;
+    const double Under = 0.75;
+}
+
+DynamicResolution::DynamicResolution(float minScale, float maxScale)
+    : MinScale(minScale), MaxScale(maxScale), Scale(maxScale), TargetMs(1000.0 / 60.0),
+      SmoothedMs(0.0), HasSample(false), FramesSinceChange(0)
+{
+}
+
+void DynamicResolution::setTarget(double ms)
+{
+    TargetMs = ms;
+}
+
+double DynamicResolution::getTarget() const
+{
+    return TargetMs;
+}
+
+void DynamicResolution::setRange(float minScale, float maxScale)
+{
+    MinScale = minScale;
+    MaxScale = maxScale;
+    Scale    = std::min(std::max(Scale, MinScale), MaxScale);
+}
+
+void DynamicResolution::reset(float scale)
+{
+    Scale             = std::min(std::max(quantize(scale), MinScale), MaxScale);
+    HasSample         = false;
+    FramesSinceChange = 0;
+}
+
+float DynamicResolution::quantize(float scale) const
+{
+    return std::floor(scale / Step + 0.5f) * Step;
+}
+
+bool DynamicResolution::update(double gpuMs)
+{
+    if (gpuMs <= 0.0) return false;
+
+    SmoothedMs = HasSample ? SmoothedMs + Smoothing * (gpuMs - SmoothedMs) : gpuMs;
+    HasSample  = true;
+
+    if (++FramesSinceChange < Cooldown) return false;
+
+    float scale = Scale;
+    if (SmoothedMs > TargetMs * Over) {
+        // Straight to the scale whose pixel count fits, at least one step down
+        float fit = Scale * (float)std::sqrt(TargetMs / SmoothedMs);
+        scale = std::min(std::floor(fit / Step) * Step, Scale - Step);
+    } else if (SmoothedMs < TargetMs * Under) {
+        scale = Scale + Step;
+    }
+    scale = std::min(std::max(scale, MinScale), MaxScale);
+
+    if (std::fabs(scale - Scale) < 0.5f * Step) return false;
+
+    Scale             = scale;
+    HasSample         = false;
+    FramesSinceChange = 0;
+    return true;
+}
+
+float DynamicResolution::getScale() const
+{
+    return Scale;
+}
+
+double DynamicResolution::getSmoothedMs() const
+{
+    return SmoothedMs;
+}
@@ -0,0 +1,42 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+// Render scale controller: picks the scale of an offscreen target from the measured GPU
+// time of the frames drawn into it, so that they fit a target time.
+// The GPU time is taken as proportional to the pixel count, i.e. to the square of the
+// scale. The scale moves on a grid of Step, at most once every Cooldown frames and only
+// when the smoothed time leaves the band around the target: every change reallocates the
+// render targets and the samples of the old scale are still in flight.
+class DynamicResolution
+{
+public:
+    DynamicResolution(float minScale = 0.5f, float maxScale = 1.0f);
+
+    void   setTarget(double ms);
+    double getTarget() const;
+    void   setRange(float minScale, float maxScale);
+
+    // Starts again from this scale, forgetting the samples
+    void reset(float scale);
+
+    // Feeds the GPU time of one frame. Returns true when the scale changed.
+    bool update(double gpuMs);
+
+    float  getScale() const;
+    double getSmoothedMs() const;
+
+    static const float Step;
+    static const int   Cooldown = 30;
+
+private:
+    float  quantize(float scale) const;
+
+    float  MinScale, MaxScale;
+    float  Scale;
+    double TargetMs;
+    double SmoothedMs;
+    bool   HasSample;
+    int    FramesSinceChange;
+};
+
+#endif // DYNAMICRESOLUTION_H
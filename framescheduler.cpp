@@ -0,0 +1,304 @@
+#include "framescheduler.h"
+
+#include <QStringList>
+#include <QJsonArray>
+
+#include <cmath>
+
+namespace
+{
+    const char *ModeNames[FrameScheduler::ModeCount] = { "vsync", "uncapped", "fixed", "adaptive" };
+
+    // Weight of a new frame in the smoothed times of the adaptive mode
+    const double Smoothing = 0.1;
+
+    // A frame is missed when its interval exceeds the target by this factor
+    const double MissFactor = 1.5;
+}
+
+FrameHistogram::FrameHistogram()
+    : Buckets(BucketCount, 0), Count(0)
+{
+}
+
+void FrameHistogram::clear()
+{
+    Buckets.fill(0);
+    Count = 0;
+}
+
+void FrameHistogram::add(double ms)
+{
+    int bucket = qBound(0, (int)ms, BucketCount - 1);
+    Buckets[bucket]++;
+    Count++;
+}
+
+int FrameHistogram::getCount() const
+{
+    return Count;
+}
+
+int FrameHistogram::getBucket(int bucket) const
+{
+    return Buckets[bucket];
+}
+
+int FrameHistogram::getPercentile(double p) const
+{
+    if (Count == 0) return 0;
+
+    int rank = qMin(Count - 1, (int)(p * Count));
+    int seen = 0;
+    for (int i = 0; i < BucketCount; i++) {
+        seen += Buckets[i];
+        if (seen > rank) return i + 1;
+    }
+    return BucketCount;
+}
+
+QString FrameHistogram::summary() const
+{
+    return QString("p50 %1 ms  p99 %2 ms  over %3 ms %4")
+           .arg(getPercentile(0.5))
+           .arg(getPercentile(0.99))
+           .arg((int)BucketCount - 1)
+           .arg(Buckets[BucketCount - 1]);
+}
+
+QJsonObject FrameHistogram::toJson() const
+{
+    QJsonArray buckets;
+    for (int i = 0; i < BucketCount; i++)
+        buckets.append(Buckets[i]);
+
+    QJsonObject json;
+    json["frames"]     = Count;
+    json["bucket_ms"]  = 1;
+    json["buckets"]    = buckets;
+    json["p50_ms"]     = getPercentile(0.5);
+    json["p99_ms"]     = getPercentile(0.99);
+    return json;
+}
+
+FrameScheduler::FrameScheduler(QWindow *window)
+    : Window(window), CurrentMode(VSync), Pending(false),
+      FixedRateHz(30.0), RefreshRate(60.0), Deadline(0.0), FrameStart(0.0), LastStart(-1.0),
+      HalfRate(false), WorkMs(0.0), IntervalMs(0.0), Missed(0),
+      ActivityStart(0.0), Wakeups(0), Frames(0), WakeupRate(0.0), FrameRate(0.0)
+{
+    Timer.setSingleShot(true);
+    Timer.setTimerType(Qt::PreciseTimer);
+    connect(&Timer, &QTimer::timeout, this, &FrameScheduler::timeout);
+    Clock.start();
+}
+
+void FrameScheduler::setMode(Mode mode)
+{
+    CurrentMode = mode;
+    HalfRate    = false;
+    LastStart   = -1.0;
+    Histogram.clear();
+    Missed = 0;
+
+    // The pending frame was asked for under the old mode
+    if (Pending) {
+        stop();
+        schedule();
+    }
+}
+
+FrameScheduler::Mode FrameScheduler::getMode() const
+{
+    return CurrentMode;
+}
+
+QString FrameScheduler::getModeName(Mode mode)
+{
+    return ModeNames[mode];
+}
+
+bool FrameScheduler::parseMode(const QString& name, Mode& mode)
+{
+    for (int i = 0; i < ModeCount; i++) {
+        if (name == ModeNames[i]) {
+            mode = (Mode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FrameScheduler::setFixedRate(double framesPerSecond)
+{
+    FixedRateHz = qMax(1.0, framesPerSecond);
+}
+
+double FrameScheduler::getFixedRate() const
+{
+    return FixedRateHz;
+}
+
+void FrameScheduler::setRefreshRate(double framesPerSecond)
+{
+    RefreshRate = qMax(1.0, framesPerSecond);
+}
+
+double FrameScheduler::getTime() const
+{
+    return Clock.nsecsElapsed() / 1.0e9;
+}
+
+double FrameScheduler::targetInterval() const
+{
+    switch (CurrentMode) {
+    case FixedRate: return 1000.0 / FixedRateHz;
+    case Adaptive:  return (HalfRate ? 2000.0 : 1000.0) / RefreshRate;
+    case VSync:     return 1000.0 / RefreshRate;
+    default:        return 0.0;
+    }
+}
+
+void FrameScheduler::schedule()
+{
+    if (Pending) return;
+    Pending = true;
+
+    double now = Clock.nsecsElapsed() / 1.0e6;
+
+    switch (CurrentMode) {
+    case VSync:
+        Window->requestUpdate();
+        break;
+    case Uncapped:
+        // Through the event loop, so that input is still handled between frames
+        Timer.start(0);
+        break;
+    case FixedRate:
+    case Adaptive:
+        if (CurrentMode == Adaptive && !HalfRate) {
+            Window->requestUpdate();
+            break;
+        }
+        // Next point of the grid; after a stall the grid restarts from now
+        Deadline += targetInterval();
+        if (Deadline < now) Deadline = now;
+        startTimer(Deadline);
+        break;
+    default:
+        break;
+    }
+}
+
+void FrameScheduler::startTimer(double deadline)
+{
+    double now = Clock.nsecsElapsed() / 1.0e6;
+    Timer.start(qMax(0, (int)std::floor(deadline - now)));
+}
+
+void FrameScheduler::stop()
+{
+    Timer.stop();
+    Pending   = false;
+    LastStart = -1.0;
+}
+
+void FrameScheduler::timeout()
+{
+    emit frameRequested();
+}
+
+void FrameScheduler::wakeup()
+{
+    rollActivity(Clock.nsecsElapsed() / 1.0e6);
+    Wakeups++;
+}
+
+void FrameScheduler::rollActivity(double now)
+{
+    double elapsed = now - ActivityStart;
+    if (elapsed < 1000.0) return;
+
+    WakeupRate    = Wakeups * 1000.0 / elapsed;
+    FrameRate     = Frames  * 1000.0 / elapsed;
+    Wakeups       = 0;
+    Frames        = 0;
+    ActivityStart = now;
+}
+
+double FrameScheduler::getWakeupRate() const
+{
+    // Nothing rolled the second over while idle: the running count is the better answer
+    double elapsed = Clock.nsecsElapsed() / 1.0e6 - ActivityStart;
+    return elapsed >= 1000.0 ? Wakeups * 1000.0 / elapsed : WakeupRate;
+}
+
+double FrameScheduler::getFrameRate() const
+{
+    double elapsed = Clock.nsecsElapsed() / 1.0e6 - ActivityStart;
+    return elapsed >= 1000.0 ? Frames * 1000.0 / elapsed : FrameRate;
+}
+
+void FrameScheduler::beginFrame()
+{
+    Pending    = false;
+    FrameStart = Clock.nsecsElapsed() / 1.0e6;
+    rollActivity(FrameStart);
+    Frames++;
+
+    if (LastStart >= 0.0) {
+        double interval = FrameStart - LastStart;
+        Histogram.add(interval);
+
+        double target = targetInterval();
+        if (target > 0.0 && interval > MissFactor * target) Missed++;
+
+        IntervalMs += Smoothing * (interval - IntervalMs);
+    } else {
+        IntervalMs = targetInterval();
+        Deadline   = FrameStart;
+    }
+    LastStart = FrameStart;
+}
+
+void FrameScheduler::endFrame(bool another)
+{
+    double work = Clock.nsecsElapsed() / 1.0e6 - FrameStart;
+    WorkMs += Smoothing * (work - WorkMs);
+
+    if (CurrentMode == Adaptive) {
+        double refresh = 1000.0 / RefreshRate;
+
+        // At full rate the swap blocks until the blank, so the work looks like a whole
+        // interval: only the intervals tell that frames are missed. At half rate the
+        // timer leaves the swap nothing to wait for and the work is the real cost.
+        if (!HalfRate && IntervalMs > 1.2 * refresh) {
+            HalfRate = true;
+            Deadline = FrameStart;
+        } else if (HalfRate && WorkMs < 0.75 * refresh) {
+            HalfRate   = false;
+            IntervalMs = refresh;
+        }
+    }
+
+    // The next frame after an idle stretch is not a late one
+    if (another)
+        schedule();
+    else
+        LastStart = -1.0;
+}
+
+bool FrameScheduler::isHalfRate() const
+{
+    return HalfRate;
+}
+
+int FrameScheduler::getMissedCount() const
+{
+    return Missed;
+}
+
+const FrameHistogram& FrameScheduler::getHistogram() const
+{
+    return Histogram;
+}
@@ -0,0 +1,130 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QWindow>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QString>
+#include <QJsonObject>
+#include <QVector>
+
+// Frame intervals in 1 ms buckets, the last bucket holds everything longer
+class FrameHistogram
+{
+public:
+    static const int BucketCount = 50;
+
+    FrameHistogram();
+
+    void clear();
+    void add(double ms);
+
+    int getCount() const;
+    int getBucket(int bucket) const;
+    // Upper bound in ms of the bucket holding the fraction p of the frames
+    int getPercentile(double p) const;
+
+    QString     summary() const;
+    QJsonObject toJson() const;
+
+private:
+    QVector<int> Buckets;
+    int Count;
+};
+
+// Decides when the next frame is rendered.
+//   VSync     - requestUpdate() after every frame, the swap waits for the vertical blank
+//   Uncapped  - back to back through the event loop; only without a swap interval
+//               (chosen when the context is created) does it go past the refresh rate
+//   FixedRate - timer deadlines every 1 / rate seconds, kept on a fixed grid so that
+//               late wake-ups do not accumulate
+//   Adaptive  - VSync while the frames fit the refresh interval, half the refresh rate
+//               on timer deadlines once they no longer do, back up when the work fits again
+// Time comes from a monotonic clock. Nothing is scheduled while the window is hidden,
+// nor after a frame that asks for no successor (render on demand), so an idle window
+// never wakes the CPU.
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode
+    {
+        VSync,
+        Uncapped,
+        FixedRate,
+        Adaptive,
+        ModeCount
+    };
+
+    explicit FrameScheduler(QWindow *window);
+
+    void setMode(Mode mode);
+    Mode getMode() const;
+    static QString getModeName(Mode mode);
+    static bool    parseMode(const QString& name, Mode& mode);
+
+    void   setFixedRate(double framesPerSecond);
+    double getFixedRate() const;
+    void   setRefreshRate(double framesPerSecond);
+
+    // Seconds since the scheduler was created
+    double getTime() const;
+
+    // Asks for the next frame; does nothing while one is pending
+    void schedule();
+    // Drops the pending frame, e.g. when the window is hidden; schedule() resumes
+    void stop();
+
+    // Around every rendered frame; endFrame() schedules the next one unless the window
+    // has nothing more to draw
+    void beginFrame();
+    void endFrame(bool another = true);
+
+    // Counts a wake-up of the frame loop, whether or not it renders
+    void wakeup();
+    // Per second, over the last second; an idle loop reads as zero
+    double getWakeupRate() const;
+    double getFrameRate() const;
+
+    bool isHalfRate() const;
+    int  getMissedCount() const;
+    const FrameHistogram& getHistogram() const;
+
+signals:
+    // Render now: timer driven modes. In VSync the window receives QEvent::UpdateRequest.
+    void frameRequested();
+
+private slots:
+    void timeout();
+
+private:
+    double targetInterval() const;
+    void   startTimer(double deadline);
+    void   rollActivity(double now);
+
+    QWindow       *Window;
+    Mode           CurrentMode;
+    QTimer         Timer;
+    QElapsedTimer  Clock;
+    bool           Pending;
+
+    double FixedRateHz, RefreshRate;
+    double Deadline;                // ms on Clock, timer driven modes
+    double FrameStart, LastStart;   // ms on Clock, LastStart < 0 before the first frame
+
+    // Adaptive
+    bool   HalfRate;
+    double WorkMs, IntervalMs;      // smoothed
+
+    FrameHistogram Histogram;
+    int            Missed;
+
+    // Activity of the current second and rates of the last complete one
+    double ActivityStart;
+    int    Wakeups, Frames;
+    double WakeupRate, FrameRate;
+};
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,54 @@
+#ifndef FRAMESNAPSHOT_H
+#define FRAMESNAPSHOT_H
+
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QMatrix4x4>
+#include <QStringList>
+
+#include "uniformblocks.h"
+#include "noisecache.h"
+
+// Everything a frame needs from the GUI thread, copied once per frame so that the
+// renderer never reads state that input handling may be changing.
+// The defaults match the ones of MyWindow.
+struct FrameSnapshot
+{
+    double     time   = 0.0;        // seconds
+    int        width  = 0;
+    int        height = 0;
+    QMatrix4x4 view;                // camera, spring motion included
+
+    // Derived from the above by MyWindow::prepareFrame(), on the GUI thread while the
+    // renderer is still submitting the previous frame: the renderer only copies the
+    // blocks into its uniform ring
+    QMatrix4x4  projection;
+    QMatrix4x4  viewProjection;
+    FrameBlock  frameBlock;
+    CameraBlock cameraBlock;
+
+    bool  nightVision        = false;
+    bool  showOverlay        = false;
+    bool  profileLog         = false;
+    bool  teapotTessellation = false;
+    bool  gpuCulling         = false;
+    bool  occlusionCulling   = true;
+    bool  computePass2       = false;
+    bool  dynamicScale       = false;
+    float renderScale        = 1.0f;
+    int   stressCount        = 0;
+    bool  stressRandom       = false;
+
+    // RGBA8 texels of a finished noise job, empty when there is nothing to upload.
+    // On a cache hit they point into the file mapping held by noiseMapping.
+    QByteArray noise;
+    QSharedPointer<NoiseCache> noiseMapping;
+    int        noiseWidth  = 0;
+    int        noiseHeight = 0;
+
+    // Overlay lines and profile log summary of the frame loop, which lives on the GUI thread
+    QStringList schedulerLines;
+    QString     intervalSummary;
+};
+
+#endif // FRAMESNAPSHOT_H
@@ -0,0 +1,178 @@
+#include "frustumculler.h"
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#  define CULL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define CULL_SSE2
+#endif
+
+namespace
+{
+    const int BlockSize = 8;
+}
+
+FrustumCuller::FrustumCuller()
+    : Count(0)
+{
+}
+
+void FrustumCuller::resize(int count)
+{
+    int padded = (count + BlockSize - 1) / BlockSize * BlockSize;
+
+    X.resize(padded, 0.0f);
+    Y.resize(padded, 0.0f);
+    Z.resize(padded, 0.0f);
+    R.resize(padded, -FLT_MAX);
+
+    for (int i = count; i < padded; i++)
+        R[i] = -FLT_MAX;
+
+    Count = count;
+}
+
+int FrustumCuller::getCount() const
+{
+    return Count;
+}
+
+void FrustumCuller::setSphere(int i, const float *center, float radius)
+{
+    X[i] = center[0];
+    Y[i] = center[1];
+    Z[i] = center[2];
+    R[i] = radius;
+}
+
+void FrustumCuller::getCenter(int i, float *center) const
+{
+    center[0] = X[i];
+    center[1] = Y[i];
+    center[2] = Z[i];
+}
+
+float FrustumCuller::getRadius(int i) const
+{
+    return R[i];
+}
+
+void FrustumCuller::extractPlanes(const float *m, float planes[6][4])
+{
+    // Gribb / Hartmann: combinations of the rows of the matrix, m[col * 4 + row]
+    for (int p = 0; p < 6; p++) {
+        int   row  = p / 2;
+        float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        for (int col = 0; col < 4; col++)
+            planes[p][col] = m[col * 4 + 3] + sign * m[col * 4 + row];
+
+        float length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        for (int col = 0; col < 4; col++)
+            planes[p][col] /= length;
+    }
+}
+
+const char *FrustumCuller::getPathName()
+{
+#if defined(CULL_AVX)
+    return "avx";
+#elif defined(CULL_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+int FrustumCuller::cullScalar(const float planes[6][4], unsigned char *visible, int first) const
+{
+    int count = 0;
+
+    for (int i = first; i < Count; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++) {
+            float d = planes[p][0] * X[i] + planes[p][1] * Y[i] + planes[p][2] * Z[i] + planes[p][3];
+            inside = d > -R[i];
+        }
+        visible[i] = inside ? 1 : 0;
+        count += visible[i];
+    }
+
+    return count;
+}
+
+int FrustumCuller::cull(const float planes[6][4], unsigned char *visible) const
+{
+#if defined(CULL_AVX)
+    int count = 0;
+    int blocks = Count / 8 * 8;
+
+    __m256 a[6], b[6], c[6], d[6];
+    for (int p = 0; p < 6; p++) {
+        a[p] = _mm256_set1_ps(planes[p][0]);
+        b[p] = _mm256_set1_ps(planes[p][1]);
+        c[p] = _mm256_set1_ps(planes[p][2]);
+        d[p] = _mm256_set1_ps(planes[p][3]);
+    }
+
+    for (int i = 0; i < blocks; i += 8) {
+        __m256 x    = _mm256_loadu_ps(&X[i]);
+        __m256 y    = _mm256_loadu_ps(&Y[i]);
+        __m256 z    = _mm256_loadu_ps(&Z[i]);
+        __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&R[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[p], x), _mm256_mul_ps(b[p], y)),
+                                            _mm256_add_ps(_mm256_mul_ps(c[p], z), d[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negR, _CMP_GT_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        for (int k = 0; k < 8; k++) {
+            visible[i + k] = (mask >> k) & 1;
+            count += visible[i + k];
+        }
+    }
+
+    return count + cullScalar(planes, visible, blocks);
+#elif defined(CULL_SSE2)
+    int count = 0;
+    int blocks = Count / 4 * 4;
+
+    __m128 a[6], b[6], c[6], d[6];
+    for (int p = 0; p < 6; p++) {
+        a[p] = _mm_set1_ps(planes[p][0]);
+        b[p] = _mm_set1_ps(planes[p][1]);
+        c[p] = _mm_set1_ps(planes[p][2]);
+        d[p] = _mm_set1_ps(planes[p][3]);
+    }
+
+    for (int i = 0; i < blocks; i += 4) {
+        __m128 x    = _mm_loadu_ps(&X[i]);
+        __m128 y    = _mm_loadu_ps(&Y[i]);
+        __m128 z    = _mm_loadu_ps(&Z[i]);
+        __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&R[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], x), _mm_mul_ps(b[p], y)),
+                                         _mm_add_ps(_mm_mul_ps(c[p], z), d[p]));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negR));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int k = 0; k < 4; k++) {
+            visible[i + k] = (mask >> k) & 1;
+            count += visible[i + k];
+        }
+    }
+
+    return count + cullScalar(planes, visible, blocks);
+#else
+    return cullScalar(planes, visible, 0);
+#endif
+}
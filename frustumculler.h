@@ -0,0 +1,43 @@
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include <vector>
+
+// Sphere / frustum visibility for many objects at once.
+// The world space spheres are kept as structure of arrays, so that the test runs on 8
+// spheres per instruction with AVX, 4 with SSE2, and falls back to plain C++ elsewhere.
+// The instruction set is picked at compile time.
+class FrustumCuller
+{
+public:
+    FrustumCuller();
+
+    // Keeps the spheres below count, the new ones are never visible until set
+    void resize(int count);
+    int  getCount() const;
+
+    void  setSphere(int i, const float *center, float radius);
+    void  getCenter(int i, float *center) const;
+    float getRadius(int i) const;
+
+    // Frustum planes (a, b, c, d), normalized and facing inwards, of a column-major
+    // view-projection matrix
+    static void extractPlanes(const float *viewProjection, float planes[6][4]);
+
+    // visible[i] is set to 1 when sphere i touches the frustum, 0 otherwise.
+    // Returns the number of visible spheres.
+    int cull(const float planes[6][4], unsigned char *visible) const;
+
+    // Name of the instruction set used by cull()
+    static const char *getPathName();
+
+private:
+    int cullScalar(const float planes[6][4], unsigned char *visible, int first) const;
+
+    int Count;
+
+    // Padded to a multiple of 8, padding spheres have a negative radius
+    std::vector<float> X, Y, Z, R;
+};
+
+#endif // FRUSTUMCULLER_H
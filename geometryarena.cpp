@@ -0,0 +1,149 @@
+#include "geometryarena.h"
+
+#include "vertexcache.h"
+
+#include <QDebug>
+
+#include <cstddef>
+#include <vector>
+
+GeometryArena::GeometryArena()
+    : Funcs(0), VAO(0), IndexType(GL_UNSIGNED_INT)
+{
+    Buffers[0] = Buffers[1] = 0;
+}
+
+int GeometryArena::addMesh(const float *v, const float *n, const float *tc, int nVerts,
+                           const unsigned int *el, int nIndices, const MeshBounds *bounds)
+{
+    MeshRange range;
+    range.firstIndex  = Indices.size();
+    range.indexCount  = nIndices;
+    range.baseVertex  = Vertices.size();
+    range.vertexCount = nVerts;
+    range.bounds      = bounds != 0 ? *bounds : computeBounds(v, nVerts);
+
+    // Triangle order for the post-transform cache, then vertex order for the fetches
+    std::vector<unsigned int> indices(el, el + nIndices);
+    optimizeVertexCache(indices.data(), nIndices, nVerts);
+
+    std::vector<unsigned int> remap;
+    optimizeVertexFetch(indices.data(), nIndices, nVerts, remap);
+
+    std::vector<PackedVertex> packed(nVerts);
+    packVertices(v, n, tc, nVerts, range.bounds, packed.data());
+
+    Vertices.resize(Vertices.size() + nVerts);
+    PackedVertex *dst = Vertices.data() + range.baseVertex;
+    for (int i = 0; i < nVerts; i++)
+        dst[remap[i]] = packed[i];
+
+    for (int i = 0; i < nIndices; i++)
+        Indices.append(indices[i]);
+
+    Meshes.append(range);
+    return Meshes.size() - 1;
+}
+
+void GeometryArena::upload(QOpenGLFunctions_4_3_Core *funcs)
+{
+    Funcs = funcs;
+
+    Funcs->glGenVertexArrays(1, &VAO);
+    Funcs->glBindVertexArray(VAO);
+
+    Funcs->glGenBuffers(2, Buffers);
+
+    Funcs->glBindBuffer(GL_ARRAY_BUFFER, Buffers[0]);
+    Funcs->glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(PackedVertex), Vertices.constData(), GL_STATIC_DRAW);
+
+    // Indices are local to their mesh, so 16 bits are enough unless a single mesh is huge
+    GLuint maxVertexCount = 0;
+    for (int i = 0; i < Meshes.size(); i++)
+        maxVertexCount = qMax(maxVertexCount, Meshes[i].vertexCount);
+
+    Funcs->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Buffers[1]);
+    if (maxVertexCount <= 65536) {
+        QVector<GLushort> shortIndices(Indices.size());
+        for (int i = 0; i < Indices.size(); i++)
+            shortIndices[i] = (GLushort)Indices[i];
+
+        IndexType = GL_UNSIGNED_SHORT;
+        Funcs->glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.constData(), GL_STATIC_DRAW);
+    } else {
+        IndexType = GL_UNSIGNED_INT;
+        Funcs->glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(GLuint), Indices.constData(), GL_STATIC_DRAW);
+    }
+
+    qDebug() << "Geometry arena:" << Meshes.size() << "meshes," << Vertices.size() << "vertices,"
+             << Indices.size() << (IndexType == GL_UNSIGNED_SHORT ? "16-bit" : "32-bit") << "indices";
+
+    // One interleaved stream: every attribute reads binding 0
+    Funcs->glBindVertexBuffer(0, Buffers[0], 0, sizeof(PackedVertex));
+
+    // Vertex positions: snorm16, dequantized by the model matrix
+    Funcs->glVertexAttribFormat(0, 3, GL_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+    Funcs->glVertexAttribBinding(0, 0);
+    Funcs->glEnableVertexAttribArray(0);
+
+    // Vertex normals: octahedral snorm8, decoded in the vertex shader
+    Funcs->glVertexAttribFormat(1, 2, GL_BYTE, GL_TRUE, offsetof(PackedVertex, normal));
+    Funcs->glVertexAttribBinding(1, 0);
+    Funcs->glEnableVertexAttribArray(1);
+
+    // Texture coordinates: half floats
+    Funcs->glVertexAttribFormat(2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, texCoord));
+    Funcs->glVertexAttribBinding(2, 0);
+    Funcs->glEnableVertexAttribArray(2);
+
+    // Object index, advanced once per instance starting at the command's baseInstance
+    Funcs->glVertexAttribIFormat(DrawIndexAttrib, 1, GL_UNSIGNED_INT, 0);
+    Funcs->glVertexAttribBinding(DrawIndexAttrib, DrawIndexAttrib);
+    Funcs->glVertexBindingDivisor(DrawIndexAttrib, 1);
+    Funcs->glEnableVertexAttribArray(DrawIndexAttrib);
+
+    Funcs->glBindVertexArray(0);
+
+    // The CPU copies are no longer needed
+    Vertices.clear();
+    Indices.clear();
+}
+
+void GeometryArena::release()
+{
+    Funcs->glDeleteBuffers(2, Buffers);
+    Funcs->glDeleteVertexArrays(1, &VAO);
+    VAO = 0;
+}
+
+void GeometryArena::setDrawIndexBuffer(GLuint buffer)
+{
+    Funcs->glBindVertexArray(VAO);
+    Funcs->glBindVertexBuffer(DrawIndexAttrib, buffer, 0, sizeof(GLuint));
+    Funcs->glBindVertexArray(0);
+}
+
+void GeometryArena::bind()
+{
+    Funcs->glBindVertexArray(VAO);
+}
+
+GLuint GeometryArena::getVAO() const
+{
+    return VAO;
+}
+
+GLenum GeometryArena::getIndexType() const
+{
+    return IndexType;
+}
+
+int GeometryArena::getMeshCount() const
+{
+    return Meshes.size();
+}
+
+const MeshRange& GeometryArena::getMesh(int mesh) const
+{
+    return Meshes[mesh];
+}
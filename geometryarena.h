@@ -0,0 +1,66 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <QOpenGLFunctions_4_3_Core>
+#include <QVector>
+
+#include "vertexformat.h"
+
+// Location of a mesh inside the arena, in the terms of DrawElementsIndirectCommand
+struct MeshRange
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLint  baseVertex;
+    GLuint vertexCount;
+    MeshBounds bounds;      // dequantizes the snorm16 positions of the mesh
+};
+
+// Shared vertex / index storage for every mesh of the scene.
+// Meshes are appended on the CPU, packed into PackedVertex, then uploaded once into an
+// interleaved vertex buffer and an index buffer described by a single VAO. Indices stay
+// local to their mesh and are offset by baseVertex at draw time.
+// addMesh() reorders every mesh for the post-transform cache and for vertex fetch (see
+// vertexcache.h). When no mesh has more than 65536 vertices the index buffer is uploaded
+// as GL_UNSIGNED_SHORT.
+// Positions are quantized against the mesh bounds; the object's model matrix must apply
+// MeshRange::bounds (see Scene::update).
+// Attribute 3 (DrawIndex) is a per-instance uint read from an external buffer, giving
+// each instance the index of its object record.
+class GeometryArena
+{
+public:
+    static const GLuint DrawIndexAttrib = 3;
+
+    GeometryArena();
+
+    // tc may be NULL for meshes without texture coordinates. Positions are quantized
+    // against bounds when given, otherwise against the mesh's own bounding box.
+    int  addMesh(const float *v, const float *n, const float *tc, int nVerts,
+                 const unsigned int *el, int nIndices, const MeshBounds *bounds = 0);
+    void upload(QOpenGLFunctions_4_3_Core *funcs);
+    void release();
+
+    // Buffer of consecutive GLuint read through DrawIndexAttrib, one per instance
+    void setDrawIndexBuffer(GLuint buffer);
+
+    void   bind();
+    GLuint getVAO() const;
+    GLenum getIndexType() const;
+
+    int              getMeshCount() const;
+    const MeshRange& getMesh(int mesh) const;
+
+private:
+    QOpenGLFunctions_4_3_Core *Funcs;
+
+    QVector<PackedVertex> Vertices;
+    QVector<unsigned int> Indices;
+    QVector<MeshRange>    Meshes;
+
+    GLuint VAO;
+    GLuint Buffers[2];
+    GLenum IndexType;
+};
+
+#endif // GEOMETRYARENA_H
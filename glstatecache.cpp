@@ -0,0 +1,142 @@
+#include "glstatecache.h"
+
+namespace
+{
+    const GLuint Unknown = ~0u;
+}
+
+GLStateCache::GLStateCache()
+    : Funcs(0), Issued(0), Filtered(0)
+{
+    invalidate();
+}
+
+void GLStateCache::initialize(QOpenGLFunctions_4_3_Core *funcs)
+{
+    Funcs = funcs;
+    invalidate();
+}
+
+void GLStateCache::invalidate(int state)
+{
+    if (state & ProgramState) {
+        Program = Unknown;
+        for (int i = 0; i < StageCount; i++)
+            Subroutines[i] = Unknown;
+    }
+
+    if (state & VertexArrayState)
+        VertexArray = Unknown;
+
+    if (state & TextureState) {
+        ActiveUnit = Unknown;
+        for (int i = 0; i < TextureUnits; i++)
+            Textures[i] = Unknown;
+    }
+
+    if (state & FramebufferState) {
+        DrawFramebuffer = Unknown;
+        ReadFramebuffer = Unknown;
+    }
+}
+
+void GLStateCache::beginFrame()
+{
+    invalidate();
+    Issued   = 0;
+    Filtered = 0;
+}
+
+bool GLStateCache::filter(bool redundant)
+{
+    if (redundant)
+        Filtered++;
+    else
+        Issued++;
+    return redundant;
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (filter(program == Program)) return;
+
+    Funcs->glUseProgram(program);
+    Program = program;
+    for (int i = 0; i < StageCount; i++)
+        Subroutines[i] = Unknown;
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+    if (filter(vertexArray == VertexArray)) return;
+
+    Funcs->glBindVertexArray(vertexArray);
+    VertexArray = vertexArray;
+}
+
+void GLStateCache::activeTexture(int unit)
+{
+    if (filter((GLuint)unit == ActiveUnit)) return;
+
+    Funcs->glActiveTexture(GL_TEXTURE0 + unit);
+    ActiveUnit = unit;
+}
+
+void GLStateCache::bindTexture(int unit, GLuint texture)
+{
+    Q_ASSERT(unit >= 0 && unit < TextureUnits);
+
+    if (filter(texture == Textures[unit])) return;
+
+    // Part of this bind, counted once with it
+    if ((GLuint)unit != ActiveUnit) {
+        Funcs->glActiveTexture(GL_TEXTURE0 + unit);
+        ActiveUnit = unit;
+    }
+
+    Funcs->glBindTexture(GL_TEXTURE_2D, texture);
+    Textures[unit] = texture;
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+
+    if (filter((!draw || framebuffer == DrawFramebuffer) && (!read || framebuffer == ReadFramebuffer))) return;
+
+    Funcs->glBindFramebuffer(target, framebuffer);
+    if (draw) DrawFramebuffer = framebuffer;
+    if (read) ReadFramebuffer = framebuffer;
+}
+
+void GLStateCache::setSubroutine(GLenum shaderType, GLuint index)
+{
+    int stage = stageIndex(shaderType);
+    if (filter(stage >= 0 && index == Subroutines[stage])) return;
+
+    Funcs->glUniformSubroutinesuiv(shaderType, 1, &index);
+    if (stage >= 0) Subroutines[stage] = index;
+}
+
+int GLStateCache::getIssued() const
+{
+    return Issued;
+}
+
+int GLStateCache::getFiltered() const
+{
+    return Filtered;
+}
+
+int GLStateCache::stageIndex(GLenum shaderType)
+{
+    switch (shaderType) {
+    case GL_VERTEX_SHADER:          return VertexStage;
+    case GL_TESS_CONTROL_SHADER:    return TessControlStage;
+    case GL_TESS_EVALUATION_SHADER: return TessEvaluationStage;
+    case GL_GEOMETRY_SHADER:        return GeometryStage;
+    case GL_FRAGMENT_SHADER:        return FragmentStage;
+    default:                        return -1;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include <QOpenGLFunctions_4_3_Core>
+
+// Shadow copy of the bindings the passes change: program, vertex array, 2D textures per
+// unit, draw / read framebuffers and the subroutine of each stage. A call that would set
+// the value already in place is dropped and counted as filtered.
+// Only calls made through the cache are tracked: code binding on its own (the scene, the
+// depth pyramid, the overlay painter) must be followed by invalidate() of what it touched.
+// Every frame starts from an unknown state.
+class GLStateCache
+{
+public:
+    enum StateBits
+    {
+        ProgramState      = 0x1,     // subroutines included: glUseProgram resets them
+        VertexArrayState  = 0x2,
+        TextureState      = 0x4,     // active unit included
+        FramebufferState  = 0x8,
+        AllState          = 0xF
+    };
+
+    static const int TextureUnits = 8;
+
+    GLStateCache();
+
+    void initialize(QOpenGLFunctions_4_3_Core *funcs);
+
+    // Forgets the values of the given StateBits: the next call sets them again
+    void invalidate(int state = AllState);
+
+    // Resets the counters and forgets everything
+    void beginFrame();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    void activeTexture(int unit);
+    // GL_TEXTURE_2D on a unit below TextureUnits. An issued bind leaves the unit active,
+    // a filtered one leaves the active unit as it was.
+    void bindTexture(int unit, GLuint texture);
+    // GL_FRAMEBUFFER binds both targets
+    void bindFramebuffer(GLenum target, GLuint framebuffer);
+    // The shaders have one subroutine uniform per stage
+    void setSubroutine(GLenum shaderType, GLuint index);
+
+    // Of the frame in progress
+    int getIssued() const;
+    int getFiltered() const;
+
+private:
+    enum Stage
+    {
+        VertexStage,
+        TessControlStage,
+        TessEvaluationStage,
+        GeometryStage,
+        FragmentStage,
+        StageCount
+    };
+
+    static int stageIndex(GLenum shaderType);
+    bool filter(bool redundant);
+
+    QOpenGLFunctions_4_3_Core *Funcs;
+
+    // Unknown values are ~0u, never a valid name
+    GLuint Program;
+    GLuint VertexArray;
+    GLuint ActiveUnit;
+    GLuint Textures[TextureUnits];
+    GLuint DrawFramebuffer, ReadFramebuffer;
+    GLuint Subroutines[StageCount];
+
+    int Issued, Filtered;
+};
+
+#endif // GLSTATECACHE_H
@@ -0,0 +1,98 @@
+#include "hizpyramid.h"
+
+HiZPyramid::HiZPyramid()
+    : Funcs(0), Program(0), Texture(0), Width(0), Height(0), LevelCount(0)
+{
+}
+
+void HiZPyramid::initialize(QOpenGLFunctions_4_3_Core *funcs, QOpenGLShaderProgram *program)
+{
+    Funcs   = funcs;
+    Program = program;
+}
+
+void HiZPyramid::release()
+{
+    if (Texture != 0) Funcs->glDeleteTextures(1, &Texture);
+    Texture = 0;
+}
+
+void HiZPyramid::resize(int width, int height)
+{
+    release();
+
+    Width  = width;
+    Height = height;
+    LevelCount = 1;
+    for (int size = qMax(width, height); size > 1; size /= 2)
+        LevelCount++;
+
+    // Storage is immutable: a new texture for every size
+    Funcs->glGenTextures(1, &Texture);
+    Funcs->glBindTexture(GL_TEXTURE_2D, Texture);
+    Funcs->glTexStorage2D(GL_TEXTURE_2D, LevelCount, GL_RG32F, Width, Height);
+    Funcs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    Funcs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    Funcs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    Funcs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    Funcs->glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void HiZPyramid::build(GLuint depthTexture)
+{
+    if (Program == 0 || Texture == 0) return;
+
+    Program->bind();
+    Program->setUniformValue("Depth", 0);
+
+    Funcs->glActiveTexture(GL_TEXTURE0);
+    Funcs->glBindTexture(GL_TEXTURE_2D, depthTexture);
+
+    int srcWidth = Width, srcHeight = Height;
+    for (int level = 0; level < LevelCount; level++) {
+        int dstWidth  = level == 0 ? Width  : qMax(srcWidth  / 2, 1);
+        int dstHeight = level == 0 ? Height : qMax(srcHeight / 2, 1);
+
+        // Level 0 reads the depth texture, the others the level above
+        if (level > 0)
+            Funcs->glBindImageTexture(0, Texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+        Funcs->glBindImageTexture(1, Texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+
+        Program->setUniformValue("SourceLevel", level - 1);
+        Funcs->glUniform2i(Program->uniformLocation("SourceSize"), srcWidth, srcHeight);
+        Funcs->glUniform2i(Program->uniformLocation("DestinationSize"), dstWidth, dstHeight);
+        Funcs->glDispatchCompute((dstWidth + 7) / 8, (dstHeight + 7) / 8, 1);
+        Funcs->glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        srcWidth  = dstWidth;
+        srcHeight = dstHeight;
+    }
+
+    // The culling pass reads the pyramid with texelFetch
+    Funcs->glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    Funcs->glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+    Funcs->glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+    Funcs->glBindTexture(GL_TEXTURE_2D, 0);
+    Program->release();
+}
+
+GLuint HiZPyramid::getTexture() const
+{
+    return Texture;
+}
+
+int HiZPyramid::getLevelCount() const
+{
+    return LevelCount;
+}
+
+int HiZPyramid::getWidth() const
+{
+    return Width;
+}
+
+int HiZPyramid::getHeight() const
+{
+    return Height;
+}
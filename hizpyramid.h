@@ -0,0 +1,40 @@
+#ifndef HIZPYRAMID_H
+#define HIZPYRAMID_H
+
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+
+// Hierarchical depth: an RG32F texture with a full mip chain, where each texel holds the
+// min (r) and max (g) depth of the texels it covers in the level below. Level 0 is a copy
+// of a depth texture. Built by the compute shader of hizshader.txt, one dispatch per level;
+// odd sized levels fold their last row / column into the last texel of the next level, so
+// every texel stays conservative.
+class HiZPyramid
+{
+public:
+    HiZPyramid();
+
+    void initialize(QOpenGLFunctions_4_3_Core *funcs, QOpenGLShaderProgram *program);
+    void release();
+
+    // (Re)allocates the levels for a depth texture of this size
+    void resize(int width, int height);
+
+    // Rebuilds every level from depthTexture, a depth texture of the size given to resize()
+    void build(GLuint depthTexture);
+
+    GLuint getTexture() const;
+    int    getLevelCount() const;
+    int    getWidth() const;
+    int    getHeight() const;
+
+private:
+    QOpenGLFunctions_4_3_Core *Funcs;
+    QOpenGLShaderProgram *Program;
+
+    GLuint Texture;
+    int    Width, Height;
+    int    LevelCount;
+};
+
+#endif // HIZPYRAMID_H
@@ -1,13 +1,91 @@
 #include "NightVision.h"
 
 #include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QDebug>
 
 int main(int argc, char *argv[])
 {
     QGuiApplication a(argc, argv);
 
-    MyWindow *window = new MyWindow();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+
+    // Runs without a GPU under Mesa, e.g. QT_QPA_PLATFORM=offscreen LIBGL_ALWAYS_SOFTWARE=1
+    QCommandLineOption benchmarkOption("benchmark", "Render offscreen as fast as possible and print timings as JSON.");
+    QCommandLineOption framesOption("frames", "Frames rendered per mode in benchmark mode.", "count", "500");
+    QCommandLineOption timestepOption("timestep", "Simulated seconds between benchmark frames.", "seconds", "0.016667");
+    QCommandLineOption stressOption("stress", "Replace the scene with this many teapots and tori.", "count", "0");
+    QCommandLineOption sweepOption("sweep", "Benchmark every power of two up to the stress count.");
+    QCommandLineOption tessellationOption("gpu-tessellation", "Draw the teapot from its Bezier patches with tessellation shaders.");
+    QCommandLineOption cullingOption("gpu-culling", "Cull and select the levels of the objects in a compute shader.");
+    parser.addOption(benchmarkOption);
+    parser.addOption(framesOption);
+    parser.addOption(timestepOption);
+    parser.addOption(stressOption);
+    parser.addOption(sweepOption);
+    parser.addOption(tessellationOption);
+    QCommandLineOption scaleOption("render-scale", "Render scale of the night vision pass1, 0.25 to 1, or dynamic.", "scale", "1");
+    QCommandLineOption frameModeOption("frame-mode", "Frame pacing: vsync, uncapped, fixed or adaptive.", "mode", "vsync");
+    QCommandLineOption demandOption("on-demand", "Render only when input, resize or animation changes the picture.");
+    QCommandLineOption frameRateOption("frame-rate", "Frames per second of the fixed frame mode.", "fps", "30");
+    parser.addOption(cullingOption);
+    parser.addOption(scaleOption);
+    parser.addOption(frameModeOption);
+    parser.addOption(frameRateOption);
+    parser.addOption(demandOption);
+    parser.process(a);
+
+    QString renderScale  = parser.value(scaleOption);
+    bool    dynamicScale = renderScale == "dynamic";
+    float   scale        = 1.0f;
+    if (!dynamicScale) {
+        bool scaleOk = false;
+        scale = renderScale.toFloat(&scaleOk);
+        if (!scaleOk || scale < 0.25f || scale > 1.0f) {
+            qCritical() << "Invalid render scale" << renderScale << "- expected 0.25 to 1 or dynamic";
+            return 1;
+        }
+    }
+
+    if (parser.isSet(benchmarkOption)) {
+        bool framesOk = false;
+        int frames = parser.value(framesOption).toInt(&framesOk);
+        if (!framesOk || frames <= 0) {
+            qCritical() << "Invalid frame count" << parser.value(framesOption) << "- expected a positive integer";
+            return 1;
+        }
+
+        MyWindow window(true);
+        window.setGpuTessellation(parser.isSet(tessellationOption));
+        window.setGpuCulling(parser.isSet(cullingOption));
+        if (dynamicScale)
+            window.setDynamicResolution(true);
+        else
+            window.setRenderScale(scale);
+        QJsonObject report = window.runBenchmark(frames, parser.value(timestepOption).toFloat(),
+                                                 parser.value(stressOption).toInt(), parser.isSet(sweepOption));
+        QTextStream(stdout) << QJsonDocument(report).toJson();
+        return 0;
+    }
+
+    FrameScheduler::Mode frameMode = FrameScheduler::VSync;
+    if (!FrameScheduler::parseMode(parser.value(frameModeOption), frameMode))
+        qWarning() << "Unknown frame mode" << parser.value(frameModeOption) << "- using vsync";
+
+    MyWindow *window = new MyWindow(false, frameMode);
+    window->setFixedFrameRate(parser.value(frameRateOption).toDouble());
+    window->setRenderOnDemand(parser.isSet(demandOption));
+    if (dynamicScale)
+        window->setDynamicResolution(true);
+    else
+        window->setRenderScale(scale);
     window->show();
 
-    return a.exec();
+    // Joins the render thread before the application goes away
+    int result = a.exec();
+    delete window;
+    return result;
 }
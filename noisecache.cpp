@@ -0,0 +1,98 @@
+#include "noisecache.h"
+#include "noisegenerator.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <cstring>
+
+namespace
+{
+    const char Magic[4] = { 'N', 'V', 'N', 'Z' };
+}
+
+NoiseCache::NoiseCache(float baseFreq, float persistence, int w, int h, bool periodic)
+    : Width(w), Height(h), Mapping(0)
+{
+    QByteArray key;
+    QDataStream stream(&key, QIODevice::WriteOnly);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << baseFreq << persistence << w << h << periodic
+           << NoiseGenerator::Octaves << NoiseGenerator::Version;
+
+    QString hash = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+    QString dir  = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/noise";
+
+    FileName = dir + "/" + hash + ".rgba";
+    File.setFileName(FileName);
+}
+
+NoiseCache::~NoiseCache()
+{
+    if (Mapping != 0) File.unmap(Mapping);
+    File.close();
+}
+
+const unsigned char *NoiseCache::map()
+{
+    if (Mapping != 0) return Mapping + sizeof(Header);
+
+    qint64 expected = sizeof(Header) + (qint64)Width * Height * 4;
+
+    if (!File.open(QIODevice::ReadOnly)) return 0;
+    if (File.size() != expected) {
+        File.close();
+        return 0;
+    }
+
+    uchar *mapping = File.map(0, expected);
+    if (mapping == 0) {
+        File.close();
+        return 0;
+    }
+
+    const Header *header = reinterpret_cast<const Header *>(mapping);
+    if (memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != NoiseGenerator::Version ||
+        header->width != Width || header->height != Height) {
+        File.unmap(mapping);
+        File.close();
+        return 0;
+    }
+
+    Mapping = mapping;
+    return Mapping + sizeof(Header);
+}
+
+bool NoiseCache::store(const unsigned char *data, int byteCount)
+{
+    if (!QDir().mkpath(QFileInfo(FileName).absolutePath())) return false;
+
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = NoiseGenerator::Version;
+    header.width   = Width;
+    header.height  = Height;
+
+    // QSaveFile only replaces the cache entry once it is completely written
+    QSaveFile out(FileName);
+    if (!out.open(QIODevice::WriteOnly)) return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    out.write(reinterpret_cast<const char *>(data), byteCount);
+
+    if (!out.commit()) {
+        qDebug() << "Could not write noise cache" << FileName;
+        return false;
+    }
+    return true;
+}
+
+QString NoiseCache::getFileName() const
+{
+    return FileName;
+}
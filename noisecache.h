@@ -0,0 +1,39 @@
+#ifndef NOISECACHE_H
+#define NOISECACHE_H
+
+#include <QFile>
+#include <QString>
+
+// On-disk cache of generated noise textures.
+// Files are named after a hash of every generation parameter (including the generator
+// version) and hold a small header followed by the raw RGBA8 texels, so that a hit can
+// be uploaded straight from the memory mapping.
+class NoiseCache
+{
+public:
+    NoiseCache(float baseFreq, float persistence, int w, int h, bool periodic);
+    ~NoiseCache();
+
+    // Returns the cached texels, or 0 on a miss. Valid until the cache object is destroyed.
+    const unsigned char *map();
+    bool store(const unsigned char *data, int byteCount);
+
+    QString getFileName() const;
+
+private:
+    struct Header
+    {
+        char magic[4];
+        int  version;
+        int  width;
+        int  height;
+    };
+
+    int     Width;
+    int     Height;
+    QString FileName;
+    QFile   File;
+    uchar  *Mapping;
+};
+
+#endif // NOISECACHE_H
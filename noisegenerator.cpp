@@ -0,0 +1,304 @@
+#include "noisegenerator.h"
+
+#include <QVector>
+#include <QtConcurrent>
+
+#include <gtc/noise.hpp>
+
+#include <cstring>
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#  define NOISE_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define NOISE_SSE2
+#endif
+
+namespace
+{
+    // Number of rows handed to a worker at once: small enough to balance, big enough to
+    // keep scheduling overhead negligible.
+    const int RowsPerBand = 16;
+
+    struct RowBand
+    {
+        int begin;
+        int end;
+    };
+
+#if defined(NOISE_AVX) || defined(NOISE_SSE2)
+    // A register of floats, one texel per lane. Only the operations glm::perlin uses,
+    // each the same IEEE single precision operation as glm's scalar code.
+#if defined(NOISE_AVX)
+    struct Lanes
+    {
+        static const int Count = 8;
+        __m256 v;
+
+        Lanes(__m256 value) : v(value) {}
+        Lanes(float value) : v(_mm256_set1_ps(value)) {}
+
+        static Lanes load(const float *p) { return _mm256_loadu_ps(p); }
+        void store(float *p) const { _mm256_storeu_ps(p, v); }
+    };
+
+    inline Lanes operator+(Lanes a, Lanes b) { return _mm256_add_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a, Lanes b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Lanes operator*(Lanes a, Lanes b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Lanes operator/(Lanes a, Lanes b) { return _mm256_div_ps(a.v, b.v); }
+    inline Lanes lanesMin(Lanes a, Lanes b)  { return _mm256_min_ps(a.v, b.v); }
+    inline Lanes lanesMax(Lanes a, Lanes b)  { return _mm256_max_ps(a.v, b.v); }
+    inline Lanes lanesFloor(Lanes a)         { return _mm256_floor_ps(a.v); }
+    inline Lanes lanesAbs(Lanes a)           { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+#else
+    struct Lanes
+    {
+        static const int Count = 4;
+        __m128 v;
+
+        Lanes(__m128 value) : v(value) {}
+        Lanes(float value) : v(_mm_set1_ps(value)) {}
+
+        static Lanes load(const float *p) { return _mm_loadu_ps(p); }
+        void store(float *p) const { _mm_storeu_ps(p, v); }
+    };
+
+    inline Lanes operator+(Lanes a, Lanes b) { return _mm_add_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a, Lanes b) { return _mm_sub_ps(a.v, b.v); }
+    inline Lanes operator*(Lanes a, Lanes b) { return _mm_mul_ps(a.v, b.v); }
+    inline Lanes operator/(Lanes a, Lanes b) { return _mm_div_ps(a.v, b.v); }
+    inline Lanes lanesMin(Lanes a, Lanes b)  { return _mm_min_ps(a.v, b.v); }
+    inline Lanes lanesMax(Lanes a, Lanes b)  { return _mm_max_ps(a.v, b.v); }
+    inline Lanes lanesAbs(Lanes a)           { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+    // No round instruction before SSE4.1: truncate, then step down where that rounded up.
+    // Exact for the magnitudes met here, far below 2^31.
+    inline Lanes lanesFloor(Lanes a)
+    {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+    }
+#endif
+
+    inline Lanes lanesFract(Lanes a) { return a - lanesFloor(a); }
+    inline Lanes lanesMod(Lanes a, Lanes b) { return a - b * lanesFloor(a / b); }
+    inline Lanes lanesMod289(Lanes a) { return a - lanesFloor(a * Lanes(1.0f / 289.0f)) * Lanes(289.0f); }
+    inline Lanes lanesPermute(Lanes a) { return lanesMod289((a * Lanes(34.0f) + Lanes(1.0f)) * a); }
+
+    // glm::perlin(vec2) and glm::perlin(vec2, rep), written out corner by corner: the
+    // vec4 of corners in glm becomes four registers of texels
+    Lanes lanesPerlin(Lanes px, Lanes py, const float *rep)
+    {
+        Lanes pix0 = lanesFloor(px), piy0 = lanesFloor(py);
+        Lanes pix1 = pix0 + Lanes(1.0f), piy1 = piy0 + Lanes(1.0f);
+        Lanes pfx0 = lanesFract(px), pfy0 = lanesFract(py);
+        Lanes pfx1 = pfx0 - Lanes(1.0f), pfy1 = pfy0 - Lanes(1.0f);
+
+        if (rep != 0) {
+            pix0 = lanesMod(pix0, Lanes(rep[0]));
+            piy0 = lanesMod(piy0, Lanes(rep[1]));
+            pix1 = lanesMod(pix1, Lanes(rep[0]));
+            piy1 = lanesMod(piy1, Lanes(rep[1]));
+        }
+        pix0 = lanesMod(pix0, Lanes(289.0f));
+        piy0 = lanesMod(piy0, Lanes(289.0f));
+        pix1 = lanesMod(pix1, Lanes(289.0f));
+        piy1 = lanesMod(piy1, Lanes(289.0f));
+
+        // Corners in glm's order: 00, 10, 01, 11
+        Lanes ix[4] = { pix0, pix1, pix0, pix1 };
+        Lanes iy[4] = { piy0, piy0, piy1, piy1 };
+        Lanes fx[4] = { pfx0, pfx1, pfx0, pfx1 };
+        Lanes fy[4] = { pfy0, pfy0, pfy1, pfy1 };
+
+        Lanes n[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int c = 0; c < 4; c++) {
+            Lanes i  = lanesPermute(lanesPermute(ix[c]) + iy[c]);
+            Lanes gx = Lanes(2.0f) * lanesFract(i / Lanes(41.0f)) - Lanes(1.0f);
+            Lanes gy = lanesAbs(gx) - Lanes(0.5f);
+            Lanes tx = lanesFloor(gx + Lanes(0.5f));
+            gx = gx - tx;
+
+            Lanes norm = Lanes(1.79284291400159f) - Lanes(0.85373472095314f) * (gx * gx + gy * gy);
+            gx = gx * norm;
+            gy = gy * norm;
+            n[c] = gx * fx[c] + gy * fy[c];
+        }
+
+        Lanes fadeX = pfx0 * pfx0 * pfx0 * (pfx0 * (pfx0 * Lanes(6.0f) - Lanes(15.0f)) + Lanes(10.0f));
+        Lanes fadeY = pfy0 * pfy0 * pfy0 * (pfy0 * (pfy0 * Lanes(6.0f) - Lanes(15.0f)) + Lanes(10.0f));
+
+        Lanes nx0 = n[0] * (Lanes(1.0f) - fadeX) + n[1] * fadeX;
+        Lanes nx1 = n[2] * (Lanes(1.0f) - fadeX) + n[3] * fadeX;
+        Lanes nxy = nx0 * (Lanes(1.0f) - fadeY) + nx1 * fadeY;
+        return Lanes(2.3f) * nxy;
+    }
+
+    // The lanes follow one version of glm; another version, or a compiler contracting
+    // glm's operations, could round differently. Checked once against glm itself.
+    bool lanesMatchGlm()
+    {
+        const float reps[3] = { 4.0f, 200.0f, 1600.0f };
+        float x[Lanes::Count], y[Lanes::Count], got[Lanes::Count];
+
+        for (int probe = 0; probe < 256; probe++) {
+            for (int k = 0; k < Lanes::Count; k++) {
+                x[k] = (probe * Lanes::Count + k) * 0.731f;
+                y[k] = probe * 1.37f + k * 0.113f;
+            }
+
+            for (int r = 0; r <= 3; r++) {
+                float rep[2] = { r < 3 ? reps[r] : 0.0f, r < 3 ? reps[r] : 0.0f };
+                lanesPerlin(Lanes::load(x), Lanes::load(y), r < 3 ? rep : 0).store(got);
+
+                for (int k = 0; k < Lanes::Count; k++) {
+                    glm::vec2 p(x[k], y[k]);
+                    float expected = r < 3 ? glm::perlin(p, glm::vec2(rep[0], rep[1])) : glm::perlin(p);
+                    if (memcmp(&expected, &got[k], sizeof(float)) != 0) return false;
+                }
+            }
+        }
+        return true;
+    }
+#endif
+}
+
+NoiseGenerator::NoiseGenerator(float baseFreq, float persistence, int w, int h, bool periodic)
+    : BaseFreq(baseFreq), Persistence(persistence), Width(w), Height(h), Periodic(periodic),
+      OffsetX(0.0f), OffsetY(0.0f)
+{
+    float freq    = baseFreq;
+    float persist = persistence;
+    for (int oct = 0; oct < Octaves; oct++) {
+        OctaveFreq[oct]    = freq;
+        OctavePersist[oct] = persist;
+        freq    *= 2.0f;
+        persist *= persistence;
+    }
+}
+
+int NoiseGenerator::getWidth() const
+{
+    return Width;
+}
+
+int NoiseGenerator::getHeight() const
+{
+    return Height;
+}
+
+int NoiseGenerator::getByteCount() const
+{
+    return Width * Height * 4;
+}
+
+void NoiseGenerator::setOffset(float x, float y)
+{
+    OffsetX = x;
+    OffsetY = y;
+}
+
+void NoiseGenerator::generate(unsigned char *out) const
+{
+    QVector<RowBand> bands;
+    for (int row = 0; row < Height; row += RowsPerBand) {
+        RowBand band;
+        band.begin = row;
+        band.end   = qMin(row + RowsPerBand, Height);
+        bands.append(band);
+    }
+
+    QtConcurrent::blockingMap(bands, [this, out](const RowBand &band) {
+        generateRows(out, band.begin, band.end);
+    });
+}
+
+bool NoiseGenerator::hasLanes()
+{
+#if defined(NOISE_AVX) || defined(NOISE_SSE2)
+    static const bool matches = lanesMatchGlm();
+    return matches;
+#else
+    return false;
+#endif
+}
+
+const char *NoiseGenerator::getPathName()
+{
+#if defined(NOISE_AVX)
+    return hasLanes() ? "avx" : "scalar";
+#elif defined(NOISE_SSE2)
+    return hasLanes() ? "sse2" : "scalar";
+#else
+    return "scalar";
+#endif
+}
+
+void NoiseGenerator::generateRows(unsigned char *out, int rowBegin, int rowEnd) const
+{
+    float xFactor = 1.0f / (Width - 1);
+    float yFactor = 1.0f / (Height - 1);
+
+    for (int row = rowBegin; row < rowEnd; row++) {
+        float y = yFactor * row;
+        unsigned char *texel = out + row * Width * 4;
+        int col = 0;
+
+#if defined(NOISE_AVX) || defined(NOISE_SSE2)
+        // A register of texels at a time, the scalar loop below takes the rest
+        if (hasLanes()) {
+            for (; col + Lanes::Count <= Width; col += Lanes::Count, texel += 4 * Lanes::Count) {
+                float x[Lanes::Count];
+                for (int k = 0; k < Lanes::Count; k++)
+                    x[k] = xFactor * (col + k);
+
+                Lanes sum = 0.0f;
+                for (int oct = 0; oct < Octaves; oct++) {
+                    float freq   = OctaveFreq[oct];
+                    float rep[2] = { freq, freq };
+                    Lanes px = Lanes::load(x) * Lanes(freq) + Lanes(OffsetX);
+                    Lanes py = Lanes(y * freq + OffsetY);
+
+                    sum = sum + lanesPerlin(px, py, Periodic ? rep : 0) * Lanes(OctavePersist[oct]);
+
+                    Lanes result = (sum + Lanes(1.0f)) / Lanes(2.0f);
+                    result = lanesMax(lanesMin(result, Lanes(1.0f)), Lanes(0.0f));
+
+                    float scaled[Lanes::Count];
+                    (result * Lanes(255.0f)).store(scaled);
+                    for (int k = 0; k < Lanes::Count; k++)
+                        texel[4 * k + oct] = (unsigned char) scaled[k];
+                }
+            }
+        }
+#endif
+
+        for (; col < Width; col++, texel += 4) {
+            float x   = xFactor * col;
+            float sum = 0.0f;
+
+            for (int oct = 0; oct < Octaves; oct++) {
+                float freq = OctaveFreq[oct];
+                glm::vec2 p(x * freq + OffsetX, y * freq + OffsetY);
+
+                float val = 0.0f;
+                if (Periodic) {
+                    val = glm::perlin(p, glm::vec2(freq)) * OctavePersist[oct];
+                } else {
+                    val = glm::perlin(p) * OctavePersist[oct];
+                }
+
+                sum += val;
+
+                float result = (sum + 1.0f) / 2.0f;
+
+                // Clamp strictly between 0 and 1
+                result = result > 1.0f ? 1.0f : result;
+                result = result < 0.0f ? 0.0f : result;
+
+                texel[oct] = (unsigned char) (result * 255.0f);
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef NOISEGENERATOR_H
+#define NOISEGENERATOR_H
+
+// Builds the 4-octave Perlin RGBA8 texture used by the night vision pass.
+// Rows are split in bands and evaluated on the global thread pool, several texels per
+// instruction where the CPU allows; every texel is computed with exactly the same float
+// operations as the former serial loop so the output is bit-identical whatever the
+// number of threads or lanes.
+class NoiseGenerator
+{
+public:
+    static const int Octaves = 4;
+    // Bump whenever the generated texels change so that cached textures are invalidated
+    static const int Version = 1;
+
+    NoiseGenerator(float baseFreq, float persistence, int w, int h, bool periodic);
+
+    int  getWidth() const;
+    int  getHeight() const;
+    int  getByteCount() const;
+
+    // Shifts the sampled noise domain, used to animate the grain. (0, 0) reproduces the
+    // original texture exactly.
+    void setOffset(float x, float y);
+
+    // out must hold getByteCount() bytes.
+    void generate(unsigned char *out) const;
+    void generateRows(unsigned char *out, int rowBegin, int rowEnd) const;
+
+    // Evaluates several texels per instruction with SSE2 or AVX when available and when
+    // a one-time probe finds it bit-identical to glm::perlin; scalar otherwise
+    static bool        hasLanes();
+    static const char *getPathName();
+
+private:
+    float BaseFreq;
+    float Persistence;
+    int   Width;
+    int   Height;
+    bool  Periodic;
+    float OffsetX;
+    float OffsetY;
+
+    // Per-octave frequency / persistence, identical to the running products of the serial loop
+    float OctaveFreq[Octaves];
+    float OctavePersist[Octaves];
+};
+
+#endif // NOISEGENERATOR_H
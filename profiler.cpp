@@ -0,0 +1,253 @@
+#include "profiler.h"
+
+#include <algorithm>
+
+RollingStats::RollingStats(int window)
+    : Next(0), Count(0)
+{
+    Samples.resize(window);
+}
+
+void RollingStats::setWindow(int window)
+{
+    Samples.resize(window);
+    clear();
+}
+
+void RollingStats::clear()
+{
+    Next  = 0;
+    Count = 0;
+}
+
+void RollingStats::add(double value)
+{
+    Samples[Next] = value;
+    Next = (Next + 1) % Samples.size();
+    if (Count < Samples.size()) Count++;
+}
+
+int RollingStats::getCount() const
+{
+    return Count;
+}
+
+double RollingStats::getMin() const
+{
+    if (Count == 0) return 0.0;
+    return *std::min_element(Samples.constBegin(), Samples.constBegin() + Count);
+}
+
+double RollingStats::getAvg() const
+{
+    if (Count == 0) return 0.0;
+
+    double sum = 0.0;
+    for (int i = 0; i < Count; i++)
+        sum += Samples[i];
+    return sum / Count;
+}
+
+double RollingStats::getP99() const
+{
+    if (Count == 0) return 0.0;
+
+    QVector<double> sorted = Samples.mid(0, Count);
+    int rank = qMin(Count - 1, (int)(0.99 * Count));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+double RollingStats::getLast() const
+{
+    if (Count == 0) return 0.0;
+    return Samples[(Next + Samples.size() - 1) % Samples.size()];
+}
+
+Profiler::Profiler(int window)
+    : Funcs(0), Window(window), Frame(0), FrameInterval(window)
+{
+}
+
+void Profiler::initialize(QOpenGLFunctions_4_3_Core *funcs)
+{
+    Funcs = funcs;
+}
+
+void Profiler::release()
+{
+    for (int i = 0; i < Scopes.size(); i++) {
+        if (Scopes[i].gpu) Funcs->glDeleteQueries(2, Scopes[i].queries);
+    }
+    Scopes.clear();
+}
+
+int Profiler::registerScope(const QString& name, bool gpu)
+{
+    Scope scope;
+    scope.name       = name;
+    scope.gpu        = gpu;
+    scope.pending[0] = scope.pending[1] = false;
+    scope.cpu.setWindow(Window);
+    scope.gpuTime.setWindow(Window);
+
+    if (gpu) Funcs->glGenQueries(2, scope.queries);
+
+    Scopes.append(scope);
+    return Scopes.size() - 1;
+}
+
+void Profiler::setWindow(int window)
+{
+    Window = window;
+    FrameInterval.setWindow(window);
+    for (int i = 0; i < Scopes.size(); i++) {
+        Scopes[i].cpu.setWindow(window);
+        Scopes[i].gpuTime.setWindow(window);
+    }
+}
+
+void Profiler::clear()
+{
+    FrameInterval.clear();
+    for (int i = 0; i < Scopes.size(); i++) {
+        Scopes[i].cpu.clear();
+        Scopes[i].gpuTime.clear();
+    }
+}
+
+void Profiler::beginFrame()
+{
+    if (FrameTimer.isValid())
+        FrameInterval.add(FrameTimer.nsecsElapsed() / 1.0e6);
+    FrameTimer.start();
+
+    // Collect the queries issued two frames ago, before they get reused this frame
+    collect(Frame & 1);
+}
+
+void Profiler::flush()
+{
+    collect(0);
+    collect(1);
+}
+
+void Profiler::collect(int slot)
+{
+    for (int i = 0; i < Scopes.size(); i++) {
+        Scope& scope = Scopes[i];
+        if (!scope.gpu || !scope.pending[slot]) continue;
+
+        GLint available = 0;
+        Funcs->glGetQueryObjectiv(scope.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 ns = 0;
+            Funcs->glGetQueryObjectui64v(scope.queries[slot], GL_QUERY_RESULT, &ns);
+            scope.gpuTime.add(ns / 1.0e6);
+        }
+        scope.pending[slot] = false;
+    }
+}
+
+void Profiler::endFrame()
+{
+    Frame++;
+}
+
+void Profiler::beginScope(int scope)
+{
+    Scope& s = Scopes[scope];
+    if (s.gpu) Funcs->glBeginQuery(GL_TIME_ELAPSED, s.queries[Frame & 1]);
+    s.timer.start();
+}
+
+void Profiler::endScope(int scope)
+{
+    Scope& s = Scopes[scope];
+    s.cpu.add(s.timer.nsecsElapsed() / 1.0e6);
+    if (s.gpu) {
+        Funcs->glEndQuery(GL_TIME_ELAPSED);
+        s.pending[Frame & 1] = true;
+    }
+}
+
+int Profiler::getScopeCount() const
+{
+    return Scopes.size();
+}
+
+QString Profiler::getScopeName(int scope) const
+{
+    return Scopes[scope].name;
+}
+
+const RollingStats& Profiler::getCpuStats(int scope) const
+{
+    return Scopes[scope].cpu;
+}
+
+const RollingStats& Profiler::getGpuStats(int scope) const
+{
+    return Scopes[scope].gpuTime;
+}
+
+const RollingStats& Profiler::getFrameIntervalStats() const
+{
+    return FrameInterval;
+}
+
+QStringList Profiler::report() const
+{
+    QStringList lines;
+
+    double avgInterval = FrameInterval.getAvg();
+    lines << QString("frame %1 ms (%2 fps)  min %3  p99 %4")
+             .arg(avgInterval, 0, 'f', 2)
+             .arg(avgInterval > 0.0 ? 1000.0 / avgInterval : 0.0, 0, 'f', 1)
+             .arg(FrameInterval.getMin(), 0, 'f', 2)
+             .arg(FrameInterval.getP99(), 0, 'f', 2);
+
+    for (int i = 0; i < Scopes.size(); i++) {
+        const Scope& s = Scopes[i];
+        if (s.cpu.getCount() == 0) continue;
+
+        QString line = QString("%1 cpu %2/%3/%4")
+                       .arg(s.name, -8)
+                       .arg(s.cpu.getMin(), 0, 'f', 3)
+                       .arg(s.cpu.getAvg(), 0, 'f', 3)
+                       .arg(s.cpu.getP99(), 0, 'f', 3);
+        if (s.gpu && s.gpuTime.getCount() > 0) {
+            line += QString("  gpu %1/%2/%3")
+                    .arg(s.gpuTime.getMin(), 0, 'f', 3)
+                    .arg(s.gpuTime.getAvg(), 0, 'f', 3)
+                    .arg(s.gpuTime.getP99(), 0, 'f', 3);
+        }
+        lines << line;
+    }
+
+    return lines;
+}
+
+QJsonObject Profiler::toJson() const
+{
+    QJsonObject result;
+
+    for (int i = 0; i < Scopes.size(); i++) {
+        const Scope& s = Scopes[i];
+        if (s.cpu.getCount() == 0) continue;
+
+        QJsonObject scope;
+        scope["cpu_ms_min"] = s.cpu.getMin();
+        scope["cpu_ms_avg"] = s.cpu.getAvg();
+        scope["cpu_ms_p99"] = s.cpu.getP99();
+        if (s.gpu) {
+            scope["gpu_samples"] = s.gpuTime.getCount();
+            scope["gpu_ms_min"]  = s.gpuTime.getMin();
+            scope["gpu_ms_avg"]  = s.gpuTime.getAvg();
+            scope["gpu_ms_p99"]  = s.gpuTime.getP99();
+        }
+        result[s.name] = scope;
+    }
+
+    return result;
+}
@@ -0,0 +1,101 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <QOpenGLFunctions_4_3_Core>
+
+// Fixed-size window of samples with min / average / 99th percentile.
+class RollingStats
+{
+public:
+    explicit RollingStats(int window = 120);
+
+    void   setWindow(int window);
+    void   clear();
+    void   add(double value);
+
+    int    getCount() const;
+    double getMin() const;
+    double getAvg() const;
+    double getP99() const;
+    double getLast() const;
+
+private:
+    QVector<double> Samples;
+    int Next;
+    int Count;
+};
+
+// CPU and GPU timing of named scopes.
+// GPU scopes use two GL_TIME_ELAPSED queries used on alternate frames: a query is only
+// read back two frames after it was issued and skipped if still not available, so the
+// profiler never stalls the pipeline. GPU scopes must not nest (GL restriction).
+class Profiler
+{
+public:
+    explicit Profiler(int window = 120);
+
+    void initialize(QOpenGLFunctions_4_3_Core *funcs);
+    void release();
+
+    int  registerScope(const QString& name, bool gpu);
+    void setWindow(int window);
+    void clear();
+
+    void beginFrame();
+    void endFrame();
+    // Reads back every outstanding query; only call once the GPU is idle (e.g. after glFinish)
+    void flush();
+
+    void beginScope(int scope);
+    void endScope(int scope);
+
+    int                 getScopeCount() const;
+    QString             getScopeName(int scope) const;
+    const RollingStats& getCpuStats(int scope) const;
+    const RollingStats& getGpuStats(int scope) const;
+    const RollingStats& getFrameIntervalStats() const;
+
+    // One line per scope, for the overlay and the log
+    QStringList report() const;
+    QJsonObject toJson() const;
+
+    class Scoped
+    {
+    public:
+        Scoped(Profiler& profiler, int scope) : Owner(profiler), Id(scope) { Owner.beginScope(Id); }
+        ~Scoped() { Owner.endScope(Id); }
+
+    private:
+        Profiler& Owner;
+        int       Id;
+    };
+
+private:
+    void collect(int slot);
+
+    struct Scope
+    {
+        QString       name;
+        bool          gpu;
+        GLuint        queries[2];
+        bool          pending[2];
+        QElapsedTimer timer;
+        RollingStats  cpu;
+        RollingStats  gpuTime;
+    };
+
+    QOpenGLFunctions_4_3_Core *Funcs;
+    QVector<Scope> Scopes;
+    int            Window;
+    int            Frame;
+    QElapsedTimer  FrameTimer;
+    RollingStats   FrameInterval;
+};
+
+#endif // PROFILER_H
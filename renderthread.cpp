@@ -0,0 +1,43 @@
+#include "renderthread.h"
+
+#include <QCoreApplication>
+
+RenderThread::RenderThread(QOpenGLContext *context, QSurface *surface, RenderFunction render)
+    : Context(context), Surface(surface), Render(render), Quit(0)
+{
+    Context->moveToThread(this);
+}
+
+bool RenderThread::post(const FrameSnapshot& frame)
+{
+    if (!Queue.push(frame)) return false;
+    Available.release();
+    return true;
+}
+
+void RenderThread::stop()
+{
+    Quit.storeRelease(1);
+    Available.release();
+    wait();
+}
+
+void RenderThread::run()
+{
+    Context->makeCurrent(Surface);
+
+    for (;;) {
+        Available.acquire();
+
+        FrameSnapshot frame;
+        if (Queue.pop(frame)) {
+            Render(frame);
+            emit frameDone();
+        } else if (Quit.loadAcquire()) {
+            break;
+        }
+    }
+
+    Context->doneCurrent();
+    Context->moveToThread(QCoreApplication::instance()->thread());
+}
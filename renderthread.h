@@ -0,0 +1,52 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <QThread>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QOpenGLContext>
+#include <QSurface>
+
+#include <functional>
+
+#include "framesnapshot.h"
+#include "spscqueue.h"
+
+// Thread owning a GL context and drawing the frames posted by the GUI thread.
+// Snapshots go through a lock-free queue; the semaphore only wakes the thread up, so an
+// idle renderer sleeps instead of polling. The context is moved to the thread when it
+// starts and handed back to the application thread when it stops.
+class RenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<void (const FrameSnapshot&)> RenderFunction;
+
+    static const int QueueSize = 4;
+
+    RenderThread(QOpenGLContext *context, QSurface *surface, RenderFunction render);
+
+    // GUI thread: false when the queue is full
+    bool post(const FrameSnapshot& frame);
+    // GUI thread: lets the frames already posted finish, then joins
+    void stop();
+
+signals:
+    // After each frame, swap included
+    void frameDone();
+
+protected:
+    void run();
+
+private:
+    QOpenGLContext *Context;
+    QSurface       *Surface;
+    RenderFunction  Render;
+
+    SpscQueue<FrameSnapshot, QueueSize> Queue;
+    QSemaphore Available;
+    QAtomicInt Quit;
+};
+
+#endif // RENDERTHREAD_H
@@ -0,0 +1,655 @@
+#include "scene.h"
+#include "uniformblocks.h"
+
+#include <QDebug>
+#include <QOpenGLContext>
+
+#include <limits>
+
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+
+const float Scene::LodHysteresis = 0.15f;
+
+Scene::Scene()
+    : Funcs(0), Arena(0), BucketCount(0), DrawnCount(0), OccludedCount(0), ProjectionScale(0.0f), Dirty(true), ListDirty(true),
+      Capacity(0), TriangleCount(0), ObjectBuffer(0), CommandBuffer(0), DrawIndexBuffer(0),
+      CullProgram(0), GpuCulling(false), CullFrame(0), MultiDrawCount(0), Occlusion(0),
+      CullObjectBuffer(0), CullMeshBuffer(0), CompactBuffer(0), StatsBuffer(0), PatchCommandBuffer(0)
+{
+    for (int i = 0; i < StatsLatency; i++)
+        StatsRing[i] = 0;
+}
+
+void Scene::initialize(QOpenGLFunctions_4_3_Core *funcs, GeometryArena *arena)
+{
+    Funcs = funcs;
+    Arena = arena;
+
+    GLuint buffers[3];
+    Funcs->glGenBuffers(3, buffers);
+    ObjectBuffer    = buffers[0];
+    CommandBuffer   = buffers[1];
+    DrawIndexBuffer = buffers[2];
+
+    GLuint cullBuffers[5];
+    Funcs->glGenBuffers(5, cullBuffers);
+    CullObjectBuffer   = cullBuffers[0];
+    CullMeshBuffer     = cullBuffers[1];
+    CompactBuffer      = cullBuffers[2];
+    StatsBuffer        = cullBuffers[3];
+    PatchCommandBuffer = cullBuffers[4];
+    Funcs->glGenBuffers(StatsLatency, StatsRing);
+
+    // Draw count taken from a buffer, for the commands compacted by the GPU culling
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (context->hasExtension("GL_ARB_indirect_parameters"))
+        MultiDrawCount = (MultiDrawElementsIndirectCount)context->getProcAddress("glMultiDrawElementsIndirectCountARB");
+    if (MultiDrawCount == 0)
+        qDebug() << "Scene: no glMultiDrawElementsIndirectCount, GPU culled commands are drawn one per bucket";
+
+    reserve(64);
+}
+
+void Scene::release()
+{
+    GLuint buffers[3] = { ObjectBuffer, CommandBuffer, DrawIndexBuffer };
+    Funcs->glDeleteBuffers(3, buffers);
+
+    GLuint cullBuffers[5] = { CullObjectBuffer, CullMeshBuffer, CompactBuffer, StatsBuffer, PatchCommandBuffer };
+    Funcs->glDeleteBuffers(5, cullBuffers);
+    Funcs->glDeleteBuffers(StatsLatency, StatsRing);
+}
+
+int Scene::addMesh(int arenaMesh, const BoundingSphere& sphere)
+{
+    QVector<int>   levels;
+    QVector<float> minPixelRadius;
+    levels         << arenaMesh;
+    minPixelRadius << 0.0f;
+    return addMesh(levels, minPixelRadius, sphere);
+}
+
+int Scene::addMesh(const QVector<int>& levels, const QVector<float>& minPixelRadius, const BoundingSphere& sphere)
+{
+    // Draw lists are reserved per level and the draw index buffer only holds MaxLevels
+    // entries per object: extra levels would overrun it
+    Q_ASSERT(levels.size() <= MaxLevels);
+    if (levels.size() > MaxLevels)
+        qWarning() << "Scene: dropping" << levels.size() - MaxLevels << "levels beyond" << (int)MaxLevels;
+
+    SceneMesh mesh;
+    mesh.levels         = levels.mid(0, MaxLevels);
+    mesh.minPixelRadius = minPixelRadius.mid(0, MaxLevels);
+    mesh.center         = QVector3D(sphere.center[0], sphere.center[1], sphere.center[2]);
+    mesh.radius         = sphere.radius;
+    mesh.firstBucket    = BucketCount;
+    mesh.patchVertices  = 0;
+
+    BucketCount += mesh.levels.size();
+    BucketMeshes.insert(BucketMeshes.size(), mesh.levels.size(), Meshes.size());
+    Meshes.append(mesh);
+    return Meshes.size() - 1;
+}
+
+void Scene::setPatchVertices(int mesh, int count)
+{
+    Meshes[mesh].patchVertices = count;
+    Dirty = true;
+}
+
+void Scene::clear()
+{
+    Objects.clear();
+    Culler.resize(0);
+    Dirty = true;
+}
+
+int Scene::addObject(int mesh, int material, const QMatrix4x4& model)
+{
+    SceneObject object;
+    object.mesh     = mesh;
+    object.material = material;
+    object.model    = model;
+    object.level    = -1;
+
+    Objects.append(object);
+    Culler.resize(Objects.size());
+    updateBounds(Objects.size() - 1);
+    Dirty = true;
+    return Objects.size() - 1;
+}
+
+void Scene::setModel(int object, const QMatrix4x4& model)
+{
+    Objects[object].model = model;
+    updateBounds(object);
+    Dirty = true;
+}
+
+void Scene::updateBounds(int i)
+{
+    const SceneObject& object = Objects[i];
+    const SceneMesh&   mesh   = Meshes[object.mesh];
+
+    // Largest scale of the model matrix, so the sphere still bounds a stretched mesh
+    float scale = qMax(object.model.column(0).toVector3D().length(),
+                       qMax(object.model.column(1).toVector3D().length(),
+                            object.model.column(2).toVector3D().length()));
+
+    QVector3D center = object.model.map(mesh.center);
+    float     world[3] = { center.x(), center.y(), center.z() };
+    Culler.setSphere(i, world, mesh.radius * scale);
+}
+
+int Scene::getObjectCount() const
+{
+    return Objects.size();
+}
+
+const SceneObject& Scene::getObject(int object) const
+{
+    return Objects[object];
+}
+
+int Scene::getCommandCount() const
+{
+    return Commands.size();
+}
+
+qint64 Scene::getTriangleCount() const
+{
+    return TriangleCount;
+}
+
+int Scene::getDrawnCount() const
+{
+    return DrawnCount;
+}
+
+int Scene::getCulledCount() const
+{
+    return qMax(Objects.size() - DrawnCount, 0);
+}
+
+int Scene::getOccludedCount() const
+{
+    return OccludedCount;
+}
+
+int Scene::getLevelCount(int mesh) const
+{
+    return Meshes[mesh].levels.size();
+}
+
+int Scene::getLevelObjects(int mesh, int level) const
+{
+    int bucket = Meshes[mesh].firstBucket + level;
+    return bucket < LevelObjects.size() ? LevelObjects[bucket] : 0;
+}
+
+const DrawElementsIndirectCommand& Scene::getCommand(int command) const
+{
+    return Commands[command];
+}
+
+int Scene::getCommandMesh(int command) const
+{
+    return CommandMeshes[command];
+}
+
+GLuint Scene::getDrawIndexBuffer() const
+{
+    return DrawIndexBuffer;
+}
+
+void Scene::setCullProgram(QOpenGLShaderProgram *program)
+{
+    CullProgram = program;
+}
+
+void Scene::setGpuCulling(bool enabled)
+{
+    if (enabled == GpuCulling) return;
+    GpuCulling = enabled;
+
+    // Either path owns the command buffer and the draw list
+    Dirty = true;
+    Visible.clear();
+}
+
+bool Scene::isGpuCulling() const
+{
+    return GpuCulling && CullProgram != 0;
+}
+
+bool Scene::hasDrawCount() const
+{
+    return MultiDrawCount != 0;
+}
+
+GLuint Scene::getPatchCommandBuffer() const
+{
+    return PatchCommandBuffer;
+}
+
+int Scene::getBucket(int mesh, int level) const
+{
+    return Meshes[mesh].firstBucket + level;
+}
+
+void Scene::setOcclusion(const HiZPyramid *pyramid, const QMatrix4x4& viewProjection)
+{
+    Occlusion = pyramid;
+    OcclusionViewProjection = viewProjection;
+}
+
+void Scene::setCamera(const QMatrix4x4& view, const QMatrix4x4& projection, int viewportHeight)
+{
+    View = view;
+    ViewProjection = projection * view;
+    ProjectionScale = 0.5f * viewportHeight * projection(1, 1);
+}
+
+void Scene::reserve(int capacity)
+{
+    if (capacity <= Capacity) return;
+    Capacity = qMax(capacity, 2 * Capacity);
+
+    // The draw list is rebuilt whenever levels change. The GPU culling gives every level
+    // of a mesh room for all of its objects.
+    Funcs->glBindBuffer(GL_ARRAY_BUFFER, DrawIndexBuffer);
+    Funcs->glBufferData(GL_ARRAY_BUFFER, Capacity * MaxLevels * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    Funcs->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, ObjectBuffer);
+    Funcs->glBufferData(GL_SHADER_STORAGE_BUFFER, Capacity * sizeof(ObjectRecord), NULL, GL_DYNAMIC_DRAW);
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, CullObjectBuffer);
+    Funcs->glBufferData(GL_SHADER_STORAGE_BUFFER, Capacity * sizeof(CullObjectRecord), NULL, GL_DYNAMIC_DRAW);
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    Arena->setDrawIndexBuffer(DrawIndexBuffer);
+
+    // Both buffers lost their contents
+    Dirty = true;
+}
+
+void Scene::update()
+{
+    reserve(Objects.size());
+
+    if (Dirty) {
+        Dirty = false;
+        ListDirty = true;
+
+        QVector<ObjectRecord> records(Objects.size());
+        for (int i = 0; i < Objects.size(); i++) {
+            const SceneObject& object = Objects[i];
+            const MeshBounds&  bounds = Arena->getMesh(Meshes[object.mesh].levels.first()).bounds;
+            ObjectRecord& record = records[i];
+
+            // Fold the dequantization of the snorm16 positions into the model matrix.
+            // Normals are not quantized against the bounds and keep the plain normal matrix.
+            QMatrix4x4 model = object.model;
+            model.translate(bounds.center[0], bounds.center[1], bounds.center[2]);
+            model.scale(bounds.extent[0], bounds.extent[1], bounds.extent[2]);
+
+            storeMat4(record.model,       model);
+            storeMat3(record.modelNormal, object.model.normalMatrix());
+            record.material = object.material;
+            record.pad[0] = record.pad[1] = record.pad[2] = 0;
+        }
+
+        Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, ObjectBuffer);
+        Funcs->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, records.size() * sizeof(ObjectRecord), records.constData());
+        Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        if (isGpuCulling())
+            uploadCullData();
+    }
+
+    if (isGpuCulling()) {
+        cullOnGpu();
+        return;
+    }
+
+    if (cull())
+        ListDirty = true;
+    if (selectLevels())
+        ListDirty = true;
+
+    if (!ListDirty) return;
+    ListDirty = false;
+
+    buildDrawList();
+}
+
+bool Scene::cull()
+{
+    float planes[6][4];
+    FrustumCuller::extractPlanes(ViewProjection.constData(), planes);
+
+    QVector<unsigned char> visible(Objects.size());
+    DrawnCount = Culler.cull(planes, visible.data());
+    OccludedCount = 0;
+
+    bool changed = visible != Visible;
+    Visible.swap(visible);
+    return changed;
+}
+
+bool Scene::selectLevels()
+{
+    bool changed = false;
+
+    for (int i = 0; i < Objects.size(); i++) {
+        if (!Visible[i]) continue;
+
+        SceneObject& object = Objects[i];
+        const SceneMesh& mesh = Meshes[object.mesh];
+        int levels = mesh.levels.size();
+
+        float center[3];
+        Culler.getCenter(i, center);
+        float radius = Culler.getRadius(i);
+
+        // Projected radius of the bounding sphere; the finest level once the camera is in it
+        float depth  = -View.map(QVector3D(center[0], center[1], center[2])).z();
+        float pixels = depth > radius ? radius * ProjectionScale / depth
+                                      : std::numeric_limits<float>::max();
+
+        // Step from the current level, crossing a threshold only beyond the margin
+        int level = qMax(object.level, 0);
+        while (level + 1 < levels && pixels > mesh.minPixelRadius[level + 1] * (1.0f + LodHysteresis))
+            level++;
+        while (level > 0 && pixels < mesh.minPixelRadius[level] * (1.0f - LodHysteresis))
+            level--;
+
+        if (level != object.level) {
+            object.level = level;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void Scene::buildDrawList()
+{
+    // Counting sort of the visible object indices by mesh level, keeping the object order
+    // within a bucket
+    LevelObjects.fill(0, BucketCount);
+    for (int i = 0; i < Objects.size(); i++)
+        if (Visible[i])
+            LevelObjects[Meshes[Objects[i].mesh].firstBucket + Objects[i].level]++;
+
+    QVector<int> offsets(BucketCount);
+    int offset = 0;
+    for (int bucket = 0; bucket < BucketCount; bucket++) {
+        offsets[bucket] = offset;
+        offset += LevelObjects[bucket];
+    }
+
+    QVector<GLuint> drawList(offset);
+    for (int i = 0; i < Objects.size(); i++)
+        if (Visible[i])
+            drawList[offsets[Meshes[Objects[i].mesh].firstBucket + Objects[i].level]++] = i;
+
+    // One instanced command per non-empty bucket, in scene mesh order
+    Commands.clear();
+    CommandMeshes.clear();
+    TriangleCount = 0;
+
+    int first = 0;
+    for (int mesh = 0; mesh < Meshes.size(); mesh++) {
+        for (int level = 0; level < Meshes[mesh].levels.size(); level++) {
+            int count = LevelObjects[Meshes[mesh].firstBucket + level];
+            if (count == 0) continue;
+
+            const MeshRange& range = Arena->getMesh(Meshes[mesh].levels[level]);
+            DrawElementsIndirectCommand command;
+            command.count         = range.indexCount;
+            command.instanceCount = count;
+            command.firstIndex    = range.firstIndex;
+            command.baseVertex    = range.baseVertex;
+            command.baseInstance  = first;
+            Commands.append(command);
+            CommandMeshes.append(mesh);
+
+            TriangleCount += (qint64)count * (range.indexCount / 3);
+            first += count;
+        }
+    }
+
+    Funcs->glBindBuffer(GL_ARRAY_BUFFER, DrawIndexBuffer);
+    Funcs->glBufferData(GL_ARRAY_BUFFER, Capacity * MaxLevels * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    Funcs->glBufferSubData(GL_ARRAY_BUFFER, 0, drawList.size() * sizeof(GLuint), drawList.constData());
+    Funcs->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, CommandBuffer);
+    Funcs->glBufferData(GL_DRAW_INDIRECT_BUFFER, Commands.size() * sizeof(DrawElementsIndirectCommand), Commands.constData(), GL_DYNAMIC_DRAW);
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void Scene::bindObjects()
+{
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ObjectStorageBinding, ObjectBuffer);
+}
+
+void Scene::uploadCullData()
+{
+    // World space spheres, and the level each object starts from
+    QVector<CullObjectRecord> objects(Objects.size());
+    QVector<int> meshObjects(Meshes.size(), 0);
+    for (int i = 0; i < Objects.size(); i++) {
+        CullObjectRecord& record = objects[i];
+        Culler.getCenter(i, record.sphere);
+        record.sphere[3] = Culler.getRadius(i);
+        record.mesh      = Objects[i].mesh;
+        record.level     = Objects[i].level;
+        record.pad[0] = record.pad[1] = 0;
+        meshObjects[Objects[i].mesh]++;
+    }
+
+    // One command per bucket, each with a draw list range for every object of its mesh
+    QVector<CullMeshRecord> meshes(Meshes.size());
+    BucketCommands.resize(BucketCount);
+    PatchCommands.resize(BucketCount);
+
+    int first = 0;
+    for (int mesh = 0; mesh < Meshes.size(); mesh++) {
+        const SceneMesh& sceneMesh = Meshes[mesh];
+        int levels = sceneMesh.levels.size();
+
+        CullMeshRecord& record = meshes[mesh];
+        for (int level = 0; level < MaxLevels; level++)
+            record.minPixelRadius[level] = level < levels ? sceneMesh.minPixelRadius[level] : 0.0f;
+        record.firstBucket = sceneMesh.firstBucket;
+        record.levelCount  = levels;
+        record.pad[0] = record.pad[1] = 0;
+
+        for (int level = 0; level < sceneMesh.levels.size(); level++) {
+            const MeshRange& range = Arena->getMesh(sceneMesh.levels[level]);
+            int bucket = sceneMesh.firstBucket + level;
+
+            DrawElementsIndirectCommand& command = BucketCommands[bucket];
+            command.count         = range.indexCount;
+            command.instanceCount = 0;
+            command.firstIndex    = range.firstIndex;
+            command.baseVertex    = range.baseVertex;
+            command.baseInstance  = first;
+
+            DrawArraysIndirectCommand& patches = PatchCommands[bucket];
+            patches.count         = sceneMesh.patchVertices;
+            patches.instanceCount = 0;
+            patches.first         = 0;
+            patches.baseInstance  = first;
+
+            first += meshObjects[mesh];
+        }
+    }
+
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, CullObjectBuffer);
+    Funcs->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, objects.size() * sizeof(CullObjectRecord), objects.constData());
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, CullMeshBuffer);
+    Funcs->glBufferData(GL_SHADER_STORAGE_BUFFER, meshes.size() * sizeof(CullMeshRecord), meshes.constData(), GL_STATIC_DRAW);
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Bucket sized buffers, refilled by every culling pass
+    GLsizeiptr commandBytes = BucketCount * sizeof(DrawElementsIndirectCommand);
+    GLsizeiptr statsBytes   = sizeof(CullStatsHeader) + BucketCount * sizeof(GLuint);
+
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, CommandBuffer);
+    Funcs->glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBytes, NULL, GL_DYNAMIC_DRAW);
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, CompactBuffer);
+    Funcs->glBufferData(GL_DRAW_INDIRECT_BUFFER, commandBytes, NULL, GL_DYNAMIC_DRAW);
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, PatchCommandBuffer);
+    Funcs->glBufferData(GL_DRAW_INDIRECT_BUFFER, BucketCount * sizeof(DrawArraysIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, StatsBuffer);
+    Funcs->glBufferData(GL_SHADER_STORAGE_BUFFER, statsBytes, NULL, GL_DYNAMIC_COPY);
+    for (int i = 0; i < StatsLatency; i++) {
+        Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, StatsRing[i]);
+        Funcs->glBufferData(GL_SHADER_STORAGE_BUFFER, statsBytes, NULL, GL_STREAM_READ);
+    }
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    CullFrame = 0;
+}
+
+void Scene::cullOnGpu()
+{
+    readCullStats();
+
+    // Instance counts start from zero every frame
+    CullStatsHeader header = { 0, 0, 0, 0 };
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, CommandBuffer);
+    Funcs->glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, BucketCommands.size() * sizeof(DrawElementsIndirectCommand), BucketCommands.constData());
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, PatchCommandBuffer);
+    Funcs->glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, PatchCommands.size() * sizeof(DrawArraysIndirectCommand), PatchCommands.constData());
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, StatsBuffer);
+    Funcs->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), &header);
+    Funcs->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    float planes[6][4];
+    FrustumCuller::extractPlanes(ViewProjection.constData(), planes);
+
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CullObjectBinding,     CullObjectBuffer);
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CullMeshBinding,       CullMeshBuffer);
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CommandStorageBinding, CommandBuffer);
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DrawListBinding,       DrawIndexBuffer);
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CompactCommandBinding, CompactBuffer);
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CullStatsBinding,      StatsBuffer);
+    Funcs->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PatchCommandBinding,   PatchCommandBuffer);
+
+    CullProgram->bind();
+    CullProgram->setUniformValueArray("Planes", &planes[0][0], 6, 4);
+    CullProgram->setUniformValue("ViewMatrix", View);
+    CullProgram->setUniformValue("ProjectionScale", ProjectionScale);
+    CullProgram->setUniformValue("LodHysteresis", LodHysteresis);
+
+    bool occlusion = Occlusion != 0 && Occlusion->getTexture() != 0;
+    CullProgram->setUniformValue("OcclusionEnabled", (GLint)occlusion);
+    if (occlusion) {
+        Funcs->glActiveTexture(GL_TEXTURE0 + OcclusionUnit);
+        Funcs->glBindTexture(GL_TEXTURE_2D, Occlusion->getTexture());
+        Funcs->glActiveTexture(GL_TEXTURE0);
+
+        CullProgram->setUniformValue("HiZ", (GLint)OcclusionUnit);
+        CullProgram->setUniformValue("OcclusionViewProjection", OcclusionViewProjection);
+        Funcs->glUniform2i(CullProgram->uniformLocation("OcclusionSize"), Occlusion->getWidth(), Occlusion->getHeight());
+        CullProgram->setUniformValue("OcclusionLevels", Occlusion->getLevelCount());
+    }
+
+    // Objects into the buckets, then the buckets into the commands
+    CullProgram->setUniformValue("Stage", 0);
+    CullProgram->setUniformValue("ItemCount", (GLuint)Objects.size());
+    Funcs->glDispatchCompute((Objects.size() + 63) / 64, 1, 1);
+    Funcs->glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    CullProgram->setUniformValue("Stage", 1);
+    CullProgram->setUniformValue("ItemCount", (GLuint)BucketCount);
+    Funcs->glDispatchCompute((BucketCount + 63) / 64, 1, 1);
+    Funcs->glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+                           GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    CullProgram->release();
+
+    // The statistics are read back once the GPU is surely done with them
+    GLsizeiptr statsBytes = sizeof(CullStatsHeader) + BucketCount * sizeof(GLuint);
+    Funcs->glBindBuffer(GL_COPY_READ_BUFFER,  StatsBuffer);
+    Funcs->glBindBuffer(GL_COPY_WRITE_BUFFER, StatsRing[CullFrame % StatsLatency]);
+    Funcs->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, statsBytes);
+    Funcs->glBindBuffer(GL_COPY_READ_BUFFER,  0);
+    Funcs->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    CullFrame++;
+}
+
+void Scene::readCullStats()
+{
+    // Written StatsLatency - 1 frames ago
+    if (CullFrame < StatsLatency - 1) return;
+
+    QVector<GLuint> stats(sizeof(CullStatsHeader) / sizeof(GLuint) + BucketCount);
+    Funcs->glBindBuffer(GL_COPY_READ_BUFFER, StatsRing[(CullFrame + 1) % StatsLatency]);
+    Funcs->glGetBufferSubData(GL_COPY_READ_BUFFER, 0, stats.size() * sizeof(GLuint), stats.data());
+    Funcs->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    const CullStatsHeader *header = (const CullStatsHeader *)stats.constData();
+    const GLuint *instances = stats.constData() + sizeof(CullStatsHeader) / sizeof(GLuint);
+
+    DrawnCount    = header->drawnObjects;
+    OccludedCount = header->occludedObjects;
+    TriangleCount = 0;
+    LevelObjects.fill(0, BucketCount);
+    for (int bucket = 0; bucket < BucketCount; bucket++) {
+        LevelObjects[bucket] = instances[bucket];
+        TriangleCount += (qint64)instances[bucket] * (BucketCommands[bucket].count / 3);
+    }
+}
+
+void Scene::draw(int skipMesh)
+{
+    bool gpuCulling = isGpuCulling();
+    if (!gpuCulling && Commands.isEmpty()) return;
+
+    Arena->bind();
+    bindObjects();
+
+    if (gpuCulling && skipMesh < 0 && MultiDrawCount != 0) {
+        // Only the commands left by the culling pass, as many as it counted
+        Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, CompactBuffer);
+        Funcs->glBindBuffer(GL_PARAMETER_BUFFER_ARB, StatsBuffer);
+        MultiDrawCount(GL_TRIANGLES, Arena->getIndexType(), NULL, 0, BucketCount, 0);
+        Funcs->glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    } else {
+        // GPU culled buckets without instances draw nothing
+        Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, CommandBuffer);
+        drawRuns(gpuCulling ? BucketMeshes : CommandMeshes, skipMesh);
+    }
+
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    Funcs->glBindVertexArray(0);
+}
+
+void Scene::drawRuns(const QVector<int>& commandMeshes, int skipMesh)
+{
+    // One multi-draw per run of commands not using skipMesh: a single one in the usual case
+    int first = 0;
+    while (first < commandMeshes.size()) {
+        if (commandMeshes[first] == skipMesh) {
+            first++;
+            continue;
+        }
+
+        int last = first;
+        while (last + 1 < commandMeshes.size() && commandMeshes[last + 1] != skipMesh)
+            last++;
+
+        Funcs->glMultiDrawElementsIndirect(GL_TRIANGLES, Arena->getIndexType(),
+                                           ((GLubyte *)NULL + (first * sizeof(DrawElementsIndirectCommand))),
+                                           last - first + 1, 0);
+        first = last + 1;
+    }
+}
@@ -0,0 +1,218 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+#include <QVector>
+#include <QVector3D>
+
+#include "bounds.h"
+#include "frustumculler.h"
+#include "geometryarena.h"
+#include "hizpyramid.h"
+
+// A mesh of the scene: a chain of arena meshes from the coarsest to the finest level.
+// Level i is used while the projected radius of the object's bounding sphere is at least
+// minPixelRadius[i]. Every level must be quantized against the same bounds, and the
+// bounding sphere must hold every level.
+struct SceneMesh
+{
+    QVector<int>   levels;
+    QVector<float> minPixelRadius;
+    QVector3D      center;          // object space bounding sphere
+    float          radius;
+    int            firstBucket;     // draw list bucket of level 0
+    int            patchVertices;   // vertices of the patch commands, see setPatchVertices()
+};
+
+struct SceneObject
+{
+    int        mesh;
+    int        material;
+    QMatrix4x4 model;
+
+    // Level drawn when last visible; the world space bounding sphere lives in the culler
+    int        level;
+};
+
+// Layout of the records read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// Layout of the records read by glDrawArraysIndirect
+struct DrawArraysIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+// Objects drawn from the geometry arena with a single glMultiDrawElementsIndirect.
+// Object records (model matrices, material) live in a shader storage buffer. Every frame
+// the bounding spheres are tested against the view frustum, and each visible object picks
+// a level of its mesh from its size on screen; the visible objects are then bucketed by
+// arena mesh into a draw list of object indices, one instanced command per bucket. The
+// command's baseInstance points into the draw list, which is read per instance through
+// DrawIndex.
+//
+// With GPU culling the same work runs in the compute shader of cullshader.txt instead:
+// every level of a mesh owns a fixed range of the draw list, large enough for all objects
+// of the mesh, and a fixed command whose instances are counted by the shader. The CPU only
+// uploads objects when they change.
+class Scene
+{
+public:
+    // Relative margin around the level thresholds, so that objects hovering around a
+    // threshold do not switch level every frame
+    static const float LodHysteresis;
+
+    // Levels per mesh, the size of CullMesh.MinPixelRadius
+    static const int MaxLevels = 4;
+
+    // Frames between the GPU culling pass and the read back of its statistics
+    static const int StatsLatency = 3;
+
+    // Texture unit of the depth pyramid during the GPU culling pass
+    static const int OcclusionUnit = 2;
+
+    Scene();
+
+    void initialize(QOpenGLFunctions_4_3_Core *funcs, GeometryArena *arena);
+    void release();
+
+    int addMesh(int arenaMesh, const BoundingSphere& sphere);
+    int addMesh(const QVector<int>& levels, const QVector<float>& minPixelRadius, const BoundingSphere& sphere);
+
+    // Vertex count of the patch commands of mesh, for drawing it as GL_PATCHES
+    void setPatchVertices(int mesh, int count);
+
+    void clear();
+    int  addObject(int mesh, int material, const QMatrix4x4& model);
+    void setModel(int object, const QMatrix4x4& model);
+
+    int                getObjectCount() const;
+    const SceneObject& getObject(int object) const;
+    int                getCommandCount() const;
+    qint64             getTriangleCount() const;
+
+    // Objects drawn and not drawn in the last update(); culled objects include the occluded
+    int getDrawnCount() const;
+    int getCulledCount() const;
+    int getOccludedCount() const;
+
+    int getLevelCount(int mesh) const;
+    // Objects of mesh drawn at level in the last update()
+    int getLevelObjects(int mesh, int level) const;
+
+    // Commands of the last update(), with the scene mesh each one draws
+    const DrawElementsIndirectCommand& getCommand(int command) const;
+    int                                getCommandMesh(int command) const;
+    GLuint                             getDrawIndexBuffer() const;
+
+    // Compute program of cullshader.txt; without it culling stays on the CPU
+    void setCullProgram(QOpenGLShaderProgram *program);
+
+    // Culls and selects the levels in a compute pass instead of on the CPU. Level counts,
+    // drawn objects and triangles then lag StatsLatency frames behind, and getCommand()
+    // is not available.
+    void setGpuCulling(bool enabled);
+    bool isGpuCulling() const;
+    // Whether glMultiDrawElementsIndirectCount (ARB_indirect_parameters) draws the
+    // compacted commands of the GPU culling
+    bool hasDrawCount() const;
+
+    // GPU culling: one DrawArraysIndirectCommand per bucket, with the instances of the
+    // bucket's draw command and the mesh's patch vertex count
+    GLuint getPatchCommandBuffer() const;
+    int    getBucket(int mesh, int level) const;
+
+    // GPU culling also drops objects hidden in pyramid, the depth of the previous frame
+    // rendered with viewProjection. 0 turns the occlusion test off.
+    void setOcclusion(const HiZPyramid *pyramid, const QMatrix4x4& viewProjection);
+
+    // Camera used by the culling and level selection; viewportHeight in pixels
+    void setCamera(const QMatrix4x4& view, const QMatrix4x4& projection, int viewportHeight);
+
+    // Culls, selects the levels and uploads objects, draw list and commands if anything
+    // changed
+    void update();
+
+    // Binds the object records for shaders drawing scene objects by other means
+    void bindObjects();
+
+    // Draws every command, except those of skipMesh which the caller draws itself
+    void draw(int skipMesh = -1);
+
+private:
+    void reserve(int capacity);
+    void updateBounds(int object);
+    bool cull();
+    bool selectLevels();
+    void buildDrawList();
+
+    void uploadCullData();
+    void cullOnGpu();
+    void readCullStats();
+    void drawRuns(const QVector<int>& commandMeshes, int skipMesh);
+
+    typedef void (QOPENGLF_APIENTRYP MultiDrawElementsIndirectCount)(GLenum mode, GLenum type, const void *indirect,
+                                                                    GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+    QOpenGLFunctions_4_3_Core *Funcs;
+    GeometryArena *Arena;
+
+    QVector<SceneMesh>                   Meshes;
+    QVector<SceneObject>                 Objects;
+    QVector<DrawElementsIndirectCommand> Commands;
+    QVector<int>                         CommandMeshes;
+    QVector<int>                         LevelObjects;      // per bucket: mesh level
+    QVector<int>                         BucketMeshes;      // per bucket: scene mesh
+    int                                  BucketCount;
+
+    FrustumCuller          Culler;
+    QVector<unsigned char> Visible;     // per object, from the last cull()
+    int                    DrawnCount;
+    int                    OccludedCount;
+
+    QMatrix4x4 View;
+    QMatrix4x4 ViewProjection;
+    float      ProjectionScale;     // pixels per unit of radius at unit depth
+
+    bool   Dirty;
+    bool   ListDirty;
+    int    Capacity;
+    qint64 TriangleCount;
+
+    GLuint ObjectBuffer;
+    GLuint CommandBuffer;
+    GLuint DrawIndexBuffer;
+
+    // GPU culling
+    QOpenGLShaderProgram *CullProgram;
+    bool                  GpuCulling;
+    int                   CullFrame;
+    MultiDrawElementsIndirectCount MultiDrawCount;
+
+    const HiZPyramid *Occlusion;
+    QMatrix4x4        OcclusionViewProjection;
+
+    QVector<DrawElementsIndirectCommand> BucketCommands;   // with no instances, reset every frame
+    QVector<DrawArraysIndirectCommand>   PatchCommands;
+
+    GLuint CullObjectBuffer;
+    GLuint CullMeshBuffer;
+    GLuint CompactBuffer;
+    GLuint StatsBuffer;
+    GLuint PatchCommandBuffer;
+    GLuint StatsRing[StatsLatency];
+};
+
+#endif // SCENE_H
@@ -0,0 +1,54 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+// Bounded lock-free queue between exactly one producer thread and one consumer thread.
+// Head is only written by the consumer and Tail only by the producer; a slot is handed
+// over by the release store of the index that publishes it. One slot stays empty to
+// tell a full queue from an empty one.
+template <typename T, int Capacity>
+class SpscQueue
+{
+public:
+    SpscQueue() : Head(0), Tail(0) {}
+
+    // Producer: false when the queue is full
+    bool push(const T& value)
+    {
+        int tail = Tail.load(std::memory_order_relaxed);
+        int next = (tail + 1) % Size;
+        if (next == Head.load(std::memory_order_acquire)) return false;
+
+        Slots[tail] = value;
+        Tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: false when the queue is empty
+    bool pop(T& value)
+    {
+        int head = Head.load(std::memory_order_relaxed);
+        if (head == Tail.load(std::memory_order_acquire)) return false;
+
+        // Drop the slot's copy here, so that shared data is released on this side
+        value = Slots[head];
+        Slots[head] = T();
+        Head.store((head + 1) % Size, std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return Head.load(std::memory_order_acquire) == Tail.load(std::memory_order_acquire);
+    }
+
+private:
+    enum { Size = Capacity + 1 };
+
+    T Slots[Size];
+    std::atomic<int> Head;
+    std::atomic<int> Tail;
+};
+
+#endif // SPSCQUEUE_H
@@ -3,9 +3,56 @@
 
 #include <cstdio>
 
+#include <QDebug>
+#include <QHash>
+#include <QVector3D>
 #include <QVector4D>
+#include <QtConcurrent>
 #include <qmath.h>
 
+#if defined(__AVX__)
+#  include <immintrin.h>
+#  define TEAPOT_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define TEAPOT_SSE2
+#endif
+
+namespace
+{
+    // out[j] = sum of coeff[k] * basis[k][j]: one cubic curve evaluated at count points
+    void evaluateCurve(const float coeff[4], const float *const basis[4], float *out, int count)
+    {
+        int j = 0;
+
+#if defined(TEAPOT_AVX)
+        __m256 c0 = _mm256_set1_ps(coeff[0]), c1 = _mm256_set1_ps(coeff[1]);
+        __m256 c2 = _mm256_set1_ps(coeff[2]), c3 = _mm256_set1_ps(coeff[3]);
+        for (; j + 8 <= count; j += 8) {
+            __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, _mm256_loadu_ps(basis[0] + j)),
+                                                     _mm256_mul_ps(c1, _mm256_loadu_ps(basis[1] + j))),
+                                       _mm256_add_ps(_mm256_mul_ps(c2, _mm256_loadu_ps(basis[2] + j)),
+                                                     _mm256_mul_ps(c3, _mm256_loadu_ps(basis[3] + j))));
+            _mm256_storeu_ps(out + j, sum);
+        }
+#elif defined(TEAPOT_SSE2)
+        __m128 c0 = _mm_set1_ps(coeff[0]), c1 = _mm_set1_ps(coeff[1]);
+        __m128 c2 = _mm_set1_ps(coeff[2]), c3 = _mm_set1_ps(coeff[3]);
+        for (; j + 4 <= count; j += 4) {
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_loadu_ps(basis[0] + j)),
+                                               _mm_mul_ps(c1, _mm_loadu_ps(basis[1] + j))),
+                                    _mm_add_ps(_mm_mul_ps(c2, _mm_loadu_ps(basis[2] + j)),
+                                               _mm_mul_ps(c3, _mm_loadu_ps(basis[3] + j))));
+            _mm_storeu_ps(out + j, sum);
+        }
+#endif
+
+        // Scalar tail, or everything without SSE2
+        for (; j < count; j++)
+            out[j] = coeff[0] * basis[0][j] + coeff[1] * basis[1][j] + coeff[2] * basis[2][j] + coeff[3] * basis[3][j];
+    }
+}
+
 Teapot::~Teapot()
 {
     delete[] v;
@@ -18,204 +65,358 @@ Teapot::Teapot(int grid, const QMatrix4x4 & lidTransform)
 {
     nVerts = 32 * (grid + 1) * (grid + 1);
     nFaces = grid * grid * 32;
+    nElems = nFaces * 6;
     v = new float[ nVerts * 3 ];
     n = new float[ nVerts * 3 ];
     tc = new float[ nVerts * 2 ];
-    elems = new unsigned int[nFaces * 6];
+    elems = new unsigned int[nElems];
 
-    generatePatches( v, n, tc, elems, grid );
-    moveLid(grid, v, lidTransform);
-}
+    generatePatches( grid );
+    weld(grid);
+    moveLid(lidTransform);
 
-void Teapot::generatePatches(float * in_v, float * in_n, float * in_tc, unsigned int* in_el, int grid) {
-    float * B = new float[4*(grid+1)];  // Pre-computed Bernstein basis functions
-    float * dB = new float[4*(grid+1)]; // Pre-computed derivitives of basis functions
-
-    int idx = 0, elIndex = 0, tcIndex = 0;
-
-    // Pre-compute the basis functions  (Bernstein polynomials)
-    // and their derivatives
-    computeBasisFunctions(B, dB, grid);
-
-    // Build each patch
-    // The rim
-    buildPatchReflect(0, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, true, true);
-    // The body
-    buildPatchReflect(1, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, true, true);
-    buildPatchReflect(2, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, true, true);
-    // The lid
-    buildPatchReflect(3, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, true, true);
-    buildPatchReflect(4, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, true, true);
-    // The bottom
-    buildPatchReflect(5, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, true, true);
-    // The handle
-    buildPatchReflect(6, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, false, true);
-    buildPatchReflect(7, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, false, true);
-    // The spout
-    buildPatchReflect(8, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, false, true);
-    buildPatchReflect(9, B, dB, in_v, in_n, in_tc, in_el, idx, elIndex, tcIndex, grid, false, true);
-
-    delete [] B;
-    delete [] dB;
+    box = computeBox(v, nVerts);
+    sphere = computeSphere(v, nVerts);
 }
 
-void Teapot::moveLid(int grid, float *in_v, const QMatrix4x4 & lidTransform) {
+// The rim, body, lid and bottom (patches 0 to 5) are mirrored in x and y, the handle and
+// spout (6 to 9) in y only. Each instance owns a fixed range of the outputs for the given
+// grid, so the 32 instances can be built concurrently.
+QVector<Teapot::PatchJob> Teapot::patchInstances(int grid)
+{
+    QVector<PatchJob> jobs;
+    for( int patchNum = 0; patchNum < 10; patchNum++ ) {
+        bool reflectX = patchNum < 6;
 
-    int start = 3 * 12 * (grid+1) * (grid+1);
-    int end = 3 * 20 * (grid+1) * (grid+1);
+        PatchJob job;
+        job.patchNum = patchNum;
 
-    for( int i = start; i < end; i+=3 )
-    {
-        QVector4D vert = QVector4D(in_v[i], in_v[i+1], in_v[i+2], 1.0f );
-        vert = lidTransform * vert;
-        v[i] = vert.x();
-        v[i+1] = vert.y();
-        v[i+2] = vert.z();
+        // Patch without modification
+        job.reverseV = false; job.signX = 1.0f; job.signY = 1.0f; job.invertNormal = true;
+        jobs.append(job);
+
+        // Patch reflected in x
+        if( reflectX ) {
+            job.reverseV = true; job.signX = -1.0f; job.signY = 1.0f; job.invertNormal = false;
+            jobs.append(job);
+        }
+
+        // Patch reflected in y
+        job.reverseV = true; job.signX = 1.0f; job.signY = -1.0f; job.invertNormal = false;
+        jobs.append(job);
+
+        // Patch reflected in x and y
+        if( reflectX ) {
+            job.reverseV = false; job.signX = -1.0f; job.signY = -1.0f; job.invertNormal = true;
+            jobs.append(job);
+        }
+    }
+
+    int stride = grid + 1;
+    for( int i = 0; i < jobs.size(); i++ ) {
+        jobs[i].firstVertex = i * stride * stride;
+        jobs[i].firstElem   = i * grid * grid * 6;
     }
+
+    return jobs;
 }
 
-void Teapot::buildPatchReflect(int patchNum,
-                                    float *B, float *dB,
-                                    float *in_v, float *in_n,
-                                    float *in_tc, unsigned int *in_el,
-                                    int &index, int &elIndex, int &tcIndex, int grid,
-                                    bool reflectX, bool reflectY)
+QVector<float> Teapot::controlPoints()
 {
-    QVector3D patch[4][4];
-    QVector3D patchRevV[4][4];
-    getPatch(patchNum, patch, false);
-    getPatch(patchNum, patchRevV, true);
-
-    // Patch without modification
-    buildPatch(patch, B, dB, in_v, in_n, in_tc, in_el,
-               index, elIndex, tcIndex, grid, QMatrix3x3(), true);
-
-    // Patch reflected in x
-    float matxdata[9] = {
-        -1.0f, 0.0f, 0.0f,
-         0.0f, 1.0f, 0.0f,
-         0.0f, 0.0f, 1.0f};
-
-    if( reflectX ) {
-        buildPatch(patchRevV, B, dB, in_v, in_n, in_tc, in_el,
-                   index, elIndex, tcIndex, grid, QMatrix3x3(matxdata), false );
+    QVector<PatchJob> jobs = patchInstances(1);
+    QVector<float> points(jobs.size() * 16 * 4);
+
+    for( int p = 0; p < jobs.size(); p++ ) {
+        const PatchJob &job = jobs[p];
+
+        // The normal of the mirrored control net is du x dv times the determinant of the
+        // mirror, flipped once more for the instances built with invertNormal
+        float mirror = job.signX * job.signY;
+        float normalSign = job.invertNormal ? -mirror : mirror;
+
+        for( int uc = 0; uc < 4; uc++ ) {
+            for( int vc = 0; vc < 4; vc++ ) {
+                int cp = TeapotData::patchdata[job.patchNum][uc * 4 + (job.reverseV ? 3 - vc : vc)];
+                float *dst = points.data() + 4 * (p * 16 + uc * 4 + vc);
+                dst[0] = job.signX * TeapotData::cpdata[cp][0];
+                dst[1] = job.signY * TeapotData::cpdata[cp][1];
+                dst[2] = TeapotData::cpdata[cp][2];
+                dst[3] = normalSign;
+            }
+        }
     }
 
-    // Patch reflected in y
-    float matydata[9] = {
-        1.0f,  0.0f, 0.0f,
-        0.0f, -1.0f, 0.0f,
-        0.0f,  0.0f, 1.0f
-    };
+    return points;
+}
 
-    if( reflectY ) {
-        buildPatch(patchRevV, B, dB, in_v, in_n, in_tc, in_el,
-                   index, elIndex, tcIndex, grid, QMatrix3x3(matydata), false );
+void Teapot::generatePatches(int grid) {
+    // Pre-computed Bernstein basis functions and their derivatives, transposed so that
+    // BT[k * stride + j] is basis function k at grid point j
+    int stride = grid + 1;
+    QVector<float> B(4 * stride), dB(4 * stride);
+    computeBasisFunctions(B.data(), dB.data(), grid);
+
+    QVector<float> BT(4 * stride), dBT(4 * stride);
+    for( int j = 0; j < stride; j++ ) {
+        for( int k = 0; k < 4; k++ ) {
+            BT[k * stride + j]  = B[j * 4 + k];
+            dBT[k * stride + j] = dB[j * 4 + k];
+        }
     }
 
-    // Patch reflected in x and y
-    float matxydata[9] = {
-       -1.0f,  0.0f, 0.0f,
-        0.0f, -1.0f, 0.0f,
-        0.0f,  0.0f, 1.0f
-    };
-    if( reflectX && reflectY ) {
-        buildPatch(patch, B, dB, in_v, in_n, in_tc, in_el,
-                   index, elIndex, tcIndex, grid, QMatrix3x3(matxydata), true );
-    }
+    QVector<PatchJob> jobs = patchInstances(grid);
+
+    const float *basis = BT.constData();
+    const float *dBasis = dBT.constData();
+    QtConcurrent::blockingMap(jobs, [this, basis, dBasis, grid](const PatchJob &job) {
+        buildPatch(job, basis, dBasis, grid);
+    });
 }
 
-void Teapot::buildPatch(QVector3D patch[][4],
-                           float *B, float *dB,
-                           float *in_v, float *in_n, float *in_tc,
-                           unsigned int *in_el,
-                           int &index, int &elIndex, int &tcIndex, int grid, QMatrix3x3 reflect,
-                           bool invertNormal)
+// Every patch, and each of its reflections, gets its own grid of vertices, so the patch
+// borders and mirror seams are duplicated. Merge vertices closer than WeldDistance whose
+// normals agree, average their normals, and drop the triangles that collapse (patch poles).
+// The lid (patches 12 to 19) is welded separately so that moveLid can still lift it off
+// the body. Texture coordinates of the first vertex of a group are kept: they are
+// per-patch and the teapot is not textured.
+void Teapot::weld(int grid)
 {
-    int startIndex = index / 3;
-    float tcFactor = 1.0f / grid;
+    const float WeldDistance = 1.0e-4f;
+    const float CellSize     = 2.0f * WeldDistance;
+    const float MinNormalDot = 0.7f;    // about 45 degrees
 
-    for( int i = 0; i <= grid; i++ )
-    {
-        for( int j = 0 ; j <= grid; j++)
-        {
-            QVector3D pt   = mattimesvec(reflect, evaluate(i,j,B,patch));
-            QVector3D norm = mattimesvec(reflect, evaluateNormal(i,j,B,dB,patch));
-            if( invertNormal )
-                norm = -norm;
+    int patchVerts = (grid + 1) * (grid + 1);
+    int lidStart   = 12 * patchVerts;
+    int lidEnd     = 20 * patchVerts;
 
-            in_v[index] = pt.x();
-            in_v[index+1] = pt.y();
-            in_v[index+2] = pt.z();
+    QVector<int>   remap(nVerts);
+    QVector<int>   group;
+    QVector<float> wv, wn, wtc;
+    QMultiHash<quint64, int> cells;
 
-            in_n[index] = norm.x();
-            in_n[index+1] = norm.y();
-            in_n[index+2] = norm.z();
+    wv.reserve(3 * nVerts);
+    wn.reserve(3 * nVerts);
+    wtc.reserve(2 * nVerts);
 
-            in_tc[tcIndex] = i * tcFactor;
-            in_tc[tcIndex+1] = j * tcFactor;
+    for( int i = 0; i < nVerts; i++ )
+    {
+        const float *p    = v + 3 * i;
+        const float *norm = n + 3 * i;
+        int vertGroup = (i >= lidStart && i < lidEnd) ? 1 : 0;
+
+        int cx = qFloor(p[0] / CellSize);
+        int cy = qFloor(p[1] / CellSize);
+        int cz = qFloor(p[2] / CellSize);
+
+        // Look for a match in the neighbouring cells
+        int match = -1;
+        for( int dx = -1; dx <= 1 && match < 0; dx++ )
+        for( int dy = -1; dy <= 1 && match < 0; dy++ )
+        for( int dz = -1; dz <= 1 && match < 0; dz++ )
+        {
+            quint64 key = ((quint64)(quint32)(cx + dx) * 73856093u) ^
+                          ((quint64)(quint32)(cy + dy) * 19349663u << 21) ^
+                          ((quint64)(quint32)(cz + dz) * 83492791u << 42);
+
+            QMultiHash<quint64, int>::const_iterator it = cells.constFind(key);
+            for( ; it != cells.constEnd() && it.key() == key; ++it )
+            {
+                int w = it.value();
+                if( group[w] != vertGroup ) continue;
+
+                const float *q = wv.constData() + 3 * w;
+                float d0 = p[0] - q[0], d1 = p[1] - q[1], d2 = p[2] - q[2];
+                if( d0 * d0 + d1 * d1 + d2 * d2 > WeldDistance * WeldDistance ) continue;
+
+                // Zero normals (patch poles) weld with anything
+                QVector3D a(norm[0], norm[1], norm[2]);
+                QVector3D b(wn[3 * w], wn[3 * w + 1], wn[3 * w + 2]);
+                if( !a.isNull() && !b.isNull() &&
+                    QVector3D::dotProduct(a.normalized(), b.normalized()) < MinNormalDot ) continue;
+
+                match = w;
+                break;
+            }
+        }
 
-            index += 3;
-            tcIndex += 2;
+        if( match >= 0 ) {
+            // Accumulate the normal; normalized once all the vertices are merged
+            wn[3 * match]     += norm[0];
+            wn[3 * match + 1] += norm[1];
+            wn[3 * match + 2] += norm[2];
+            remap[i] = match;
+            continue;
         }
+
+        int w = group.size();
+        group.append(vertGroup);
+        wv  << p[0] << p[1] << p[2];
+        wn  << norm[0] << norm[1] << norm[2];
+        wtc << tc[2 * i] << tc[2 * i + 1];
+        remap[i] = w;
+
+        quint64 key = ((quint64)(quint32)cx * 73856093u) ^
+                      ((quint64)(quint32)cy * 19349663u << 21) ^
+                      ((quint64)(quint32)cz * 83492791u << 42);
+        cells.insert(key, w);
     }
 
-    for( int i = 0; i < grid; i++ )
+    // Remap the elements, dropping degenerate triangles
+    int weldedElems = 0;
+    for( int t = 0; t < nElems; t += 3 )
     {
-        int iStart = i * (grid+1) + startIndex;
-        int nextiStart = (i+1) * (grid+1) + startIndex;
-        for( int j = 0; j < grid; j++)
-        {
-            in_el[elIndex] = iStart + j;
-            in_el[elIndex+1] = nextiStart + j + 1;
-            in_el[elIndex+2] = nextiStart + j;
+        unsigned int a = remap[elems[t]];
+        unsigned int b = remap[elems[t + 1]];
+        unsigned int c = remap[elems[t + 2]];
+        if( a == b || b == c || a == c ) continue;
+
+        elems[weldedElems]     = a;
+        elems[weldedElems + 1] = b;
+        elems[weldedElems + 2] = c;
+        weldedElems += 3;
+    }
 
-            in_el[elIndex+3] = iStart + j;
-            in_el[elIndex+4] = iStart + j + 1;
-            in_el[elIndex+5] = nextiStart + j + 1;
+    int weldedVerts = group.size();
+    qDebug() << "Teapot: welded" << nVerts << "->" << weldedVerts << "vertices,"
+             << (nElems - weldedElems) / 3 << "degenerate triangles removed, saving"
+             << (nVerts - weldedVerts) * 8 * (int)sizeof(float) << "bytes of vertex data and"
+             << nVerts - weldedVerts << "vertex shader invocations per draw (uncached)";
 
-            elIndex += 6;
+    delete[] v;
+    delete[] n;
+    delete[] tc;
+    v  = new float[3 * weldedVerts];
+    n  = new float[3 * weldedVerts];
+    tc = new float[2 * weldedVerts];
+
+    lidVerts.clear();
+    for( int w = 0; w < weldedVerts; w++ )
+    {
+        QVector3D norm = QVector3D(wn[3 * w], wn[3 * w + 1], wn[3 * w + 2]).normalized();
+        for( int c = 0; c < 3; c++ ) {
+            v[3 * w + c] = wv[3 * w + c];
         }
+        n[3 * w]     = norm.x();
+        n[3 * w + 1] = norm.y();
+        n[3 * w + 2] = norm.z();
+        tc[2 * w]     = wtc[2 * w];
+        tc[2 * w + 1] = wtc[2 * w + 1];
+
+        if( group[w] == 1 )
+            lidVerts.append(w);
     }
+
+    nVerts = weldedVerts;
+    nElems = weldedElems;
 }
 
-QVector3D Teapot::mattimesvec(QMatrix3x3 inmat, QVector3D invec)
+void Teapot::moveLid(const QMatrix4x4 & lidTransform) {
+
+    for( int k = 0; k < lidVerts.size(); k++ )
+    {
+        int i = 3 * lidVerts[k];
+        QVector4D vert = QVector4D(v[i], v[i+1], v[i+2], 1.0f );
+        vert = lidTransform * vert;
+        v[i] = vert.x();
+        v[i+1] = vert.y();
+        v[i+2] = vert.z();
+    }
+}
+
+void Teapot::buildPatch(const PatchJob &job, const float *BT, const float *dBT, int grid)
 {
+    int stride = grid + 1;
+    float tcFactor = 1.0f / grid;
 
-    QGenericMatrix<3,3,float> m1;
-    for (int r = 0; r < 3; ++r)
-        for (int c = 0; c < 3; ++c)
-            m1(r, c) = inmat(r, c);
+    // Control points in structure-of-arrays form: c[uc][vc]
+    float cx[4][4], cy[4][4], cz[4][4];
+    for( int uc = 0; uc < 4; uc++ ) {
+        for( int vc = 0; vc < 4; vc++ ) {
+            int cp = TeapotData::patchdata[job.patchNum][uc * 4 + (job.reverseV ? 3 - vc : vc)];
+            cx[uc][vc] = TeapotData::cpdata[cp][0];
+            cy[uc][vc] = TeapotData::cpdata[cp][1];
+            cz[uc][vc] = TeapotData::cpdata[cp][2];
+        }
+    }
 
-    float data[3];
-    data[0] = invec.x();
-    data[1] = invec.y();
-    data[2] = invec.z();
+    const float *B0 = BT,  *B1 = BT + stride,  *B2 = BT + 2 * stride,  *B3 = BT + 3 * stride;
+    const float *D0 = dBT, *D1 = dBT + stride, *D2 = dBT + 2 * stride, *D3 = dBT + 3 * stride;
+    const float *const B[4] = { B0, B1, B2, B3 };
+    const float *const D[4] = { D0, D1, D2, D3 };
 
-    QGenericMatrix<1,3,float> m2(data);
+    // One row of positions and partial derivatives, in structure-of-arrays form
+    QVector<float> row(9 * stride);
+    float *px  = row.data(),          *py  = px + stride,  *pz  = py + stride;
+    float *dux = pz + stride,         *duy = dux + stride, *duz = duy + stride;
+    float *dvx = duz + stride,        *dvy = dvx + stride, *dvz = dvy + stride;
 
-    QGenericMatrix<1,3,float> result = m1 * m2;
+    for( int i = 0; i <= grid; i++ )
+    {
+        // Collapse the u direction: four cubic curves along v and their u derivatives
+        float qx[4], qy[4], qz[4], qdx[4], qdy[4], qdz[4];
+        for( int vc = 0; vc < 4; vc++ ) {
+            const float b[4]  = { B0[i], B1[i], B2[i], B3[i] };
+            const float db[4] = { D0[i], D1[i], D2[i], D3[i] };
+            qx[vc]  = b[0]  * cx[0][vc] + b[1]  * cx[1][vc] + b[2]  * cx[2][vc] + b[3]  * cx[3][vc];
+            qy[vc]  = b[0]  * cy[0][vc] + b[1]  * cy[1][vc] + b[2]  * cy[2][vc] + b[3]  * cy[3][vc];
+            qz[vc]  = b[0]  * cz[0][vc] + b[1]  * cz[1][vc] + b[2]  * cz[2][vc] + b[3]  * cz[3][vc];
+            qdx[vc] = db[0] * cx[0][vc] + db[1] * cx[1][vc] + db[2] * cx[2][vc] + db[3] * cx[3][vc];
+            qdy[vc] = db[0] * cy[0][vc] + db[1] * cy[1][vc] + db[2] * cy[2][vc] + db[3] * cy[3][vc];
+            qdz[vc] = db[0] * cz[0][vc] + db[1] * cz[1][vc] + db[2] * cz[2][vc] + db[3] * cz[3][vc];
+        }
 
-    return QVector3D(result(0,0), result(1,0), result(2,0));
-}
+        // Evaluate the curves at every v, a SIMD register of points at a time
+        evaluateCurve(qx,  B, px,  stride);
+        evaluateCurve(qy,  B, py,  stride);
+        evaluateCurve(qz,  B, pz,  stride);
+        evaluateCurve(qdx, B, dux, stride);
+        evaluateCurve(qdy, B, duy, stride);
+        evaluateCurve(qdz, B, duz, stride);
+        evaluateCurve(qx,  D, dvx, stride);
+        evaluateCurve(qy,  D, dvy, stride);
+        evaluateCurve(qz,  D, dvz, stride);
+
+        // Normals, mirroring and output. A reflection is a sign flip of x and y for both
+        // the position and the normal.
+        float nsign = job.invertNormal ? -1.0f : 1.0f;
+        for( int j = 0; j <= grid; j++ ) {
+            float nx = duy[j] * dvz[j] - duz[j] * dvy[j];
+            float ny = duz[j] * dvx[j] - dux[j] * dvz[j];
+            float nz = dux[j] * dvy[j] - duy[j] * dvx[j];
+            float len = qSqrt(nx * nx + ny * ny + nz * nz);
+            // Degenerate derivatives at the patch poles give a zero normal
+            float scale = len > 0.0f ? nsign / len : 0.0f;
+
+            int vert = job.firstVertex + i * stride + j;
+            v[3 * vert]     = job.signX * px[j];
+            v[3 * vert + 1] = job.signY * py[j];
+            v[3 * vert + 2] = pz[j];
+
+            n[3 * vert]     = job.signX * nx * scale;
+            n[3 * vert + 1] = job.signY * ny * scale;
+            n[3 * vert + 2] = nz * scale;
+
+            tc[2 * vert]     = i * tcFactor;
+            tc[2 * vert + 1] = j * tcFactor;
+        }
+    }
 
-void Teapot::getPatch( int patchNum, QVector3D patch[][4], bool reverseV )
-{
-    for( int uc = 0; uc < 4; uc++) {          // Loop in u direction
-        for( int vc = 0; vc < 4; vc++ ) {     // Loop in v direction
-            if( reverseV ) {
-                patch[uc][vc] = QVector3D(
-                        TeapotData::cpdata[TeapotData::patchdata[patchNum][uc*4+(3-vc)]][0],
-                        TeapotData::cpdata[TeapotData::patchdata[patchNum][uc*4+(3-vc)]][1],
-                        TeapotData::cpdata[TeapotData::patchdata[patchNum][uc*4+(3-vc)]][2]
-                        );
-            } else {
-                patch[uc][vc] = QVector3D(
-                        TeapotData::cpdata[TeapotData::patchdata[patchNum][uc*4+vc]][0],
-                        TeapotData::cpdata[TeapotData::patchdata[patchNum][uc*4+vc]][1],
-                        TeapotData::cpdata[TeapotData::patchdata[patchNum][uc*4+vc]][2]
-                        );
-            }
+    int elIndex = job.firstElem;
+    for( int i = 0; i < grid; i++ )
+    {
+        int iStart = i * stride + job.firstVertex;
+        int nextiStart = (i+1) * stride + job.firstVertex;
+        for( int j = 0; j < grid; j++)
+        {
+            elems[elIndex] = iStart + j;
+            elems[elIndex+1] = nextiStart + j + 1;
+            elems[elIndex+2] = nextiStart + j;
+
+            elems[elIndex+3] = iStart + j;
+            elems[elIndex+4] = iStart + j + 1;
+            elems[elIndex+5] = nextiStart + j + 1;
+
+            elIndex += 6;
         }
     }
 }
@@ -242,34 +443,6 @@ void Teapot::computeBasisFunctions( float * B, float * dB, int grid ) {
 }
 
 
-QVector3D Teapot::evaluate( int gridU, int gridV, float *B, QVector3D patch[][4] )
-{
-    QVector3D p(0.0f,0.0f,0.0f);
-    for( int i = 0; i < 4; i++) {
-        for( int j = 0; j < 4; j++) {
-            p += patch[i][j] * B[gridU*4+i] * B[gridV*4+j];
-        }
-    }
-    return p;
-}
-
-QVector3D Teapot::evaluateNormal( int gridU, int gridV, float *B, float *dB, QVector3D patch[][4] )
-{
-    QVector3D du(0.0f,0.0f,0.0f);
-    QVector3D dv(0.0f,0.0f,0.0f);
-
-    for( int i = 0; i < 4; i++) {
-        for( int j = 0; j < 4; j++) {
-            du += patch[i][j] * dB[gridU*4+i] * B[gridV*4+j];
-            dv += patch[i][j] * B[gridU*4+i] * dB[gridV*4+j];
-        }
-    }
-
-    QVector3D norm = QVector3D::normal(du, dv);
-
-    return norm;
-}
-
 float *Teapot::getv()
 {
     return v;
@@ -295,8 +468,23 @@ unsigned int *Teapot::getelems()
     return elems;
 }
 
+int Teapot::getnElems()
+{
+    return nElems;
+}
+
 int Teapot::getnFaces()
 {
     return nFaces;
 }
 
+const BoundingBox& Teapot::getBox() const
+{
+    return box;
+}
+
+const BoundingSphere& Teapot::getSphere() const
+{
+    return sphere;
+}
+
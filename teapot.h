@@ -2,8 +2,9 @@
 #define VBOTEAPOT_H
 
 #include <QMatrix4x4>
-#include <QMatrix3x3>
-#include <QVector3D>
+#include <QVector>
+
+#include "bounds.h"
 
 class Teapot
 {
@@ -22,26 +23,35 @@ private:
 
     // Elements
     unsigned int *elems;
+    int nElems;
+
+    // Bounds of the final vertices, lid moved
+    BoundingBox    box;
+    BoundingSphere sphere;
+
+    // Welded vertices belonging to the lid, moved by moveLid
+    QVector<int> lidVerts;
 
-    void generateVerts(float * , float * ,float *, unsigned int *, float , float);
+    // One patch instance: a patch of TeapotData, possibly mirrored, and where its vertices
+    // and elements go. Mirrors are sign flips of x / y; they reverse v to keep the winding.
+    struct PatchJob
+    {
+        int   patchNum;
+        bool  reverseV;
+        float signX, signY;
+        bool  invertNormal;
+        int   firstVertex;
+        int   firstElem;
+    };
 
-    void generatePatches(float * in_v, float * in_n, float *in_tc, unsigned int* in_el, int grid);
-    void buildPatchReflect(int patchNum,
-                           float *B, float *dB,
-                           float *v, float *n, float *, unsigned int *el,
-                           int &index, int &elIndex, int &, int grid,
-                           bool reflectX, bool reflectY);
-    void buildPatch(QVector3D patch[][4],
-                    float *B, float *dB,
-                    float *in_v, float *in_n, float *in_tc, unsigned int *in_el,
-                    int &index, int &elIndex, int &, int grid, QMatrix3x3 reflect, bool invertNormal);
-    void getPatch( int patchNum, QVector3D patch[][4], bool reverseV );
+    static QVector<PatchJob> patchInstances(int grid);
+
+    void generatePatches(int grid);
+    void buildPatch(const PatchJob &job, const float *BT, const float *dBT, int grid);
 
     void computeBasisFunctions( float * B, float * dB, int grid );
-    QVector3D evaluate( int gridU, int gridV, float *B, QVector3D patch[][4] );
-    QVector3D evaluateNormal( int gridU, int gridV, float *B, float *dB, QVector3D patch[][4] );
-    void moveLid(int,float *,const QMatrix4x4 &);
-    QVector3D mattimesvec(QMatrix3x3, QVector3D);
+    void weld(int grid);
+    void moveLid(const QMatrix4x4 &);
 
 public:
     ~Teapot();
@@ -52,8 +62,17 @@ public:
     float *getn();
     float *gettc();
     unsigned int *getelems();
+    int    getnElems();
 
     int    getnFaces();
+
+    const BoundingBox&    getBox() const;
+    const BoundingSphere& getSphere() const;
+
+    // Bezier control points of the 32 patch instances, mirrors applied: 16 points per
+    // patch in u-major order, as x, y, z and the sign turning du x dv into the outward
+    // normal. Used by the GPU tessellation path.
+    static QVector<float> controlPoints();
 };
 
 #endif // VBOTEAPOT_H
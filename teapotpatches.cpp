@@ -0,0 +1,77 @@
+#include "teapotpatches.h"
+#include "teapot.h"
+
+TeapotPatches::TeapotPatches()
+    : Funcs(0), VAO(0), Buffer(0), PatchCount(0)
+{
+}
+
+void TeapotPatches::initialize(QOpenGLFunctions_4_3_Core *funcs)
+{
+    Funcs = funcs;
+
+    QVector<float> points = Teapot::controlPoints();
+    PatchCount = points.size() / (4 * PatchVertices);
+
+    Funcs->glGenVertexArrays(1, &VAO);
+    Funcs->glBindVertexArray(VAO);
+
+    Funcs->glGenBuffers(1, &Buffer);
+    Funcs->glBindBuffer(GL_ARRAY_BUFFER, Buffer);
+    Funcs->glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(float), points.constData(), GL_STATIC_DRAW);
+
+    // Control point and normal sign
+    Funcs->glBindVertexBuffer(0, Buffer, 0, sizeof(GLfloat) * 4);
+    Funcs->glVertexAttribFormat(0, 4, GL_FLOAT, GL_FALSE, 0);
+    Funcs->glVertexAttribBinding(0, 0);
+    Funcs->glEnableVertexAttribArray(0);
+
+    // Object index, advanced once per instance starting at baseInstance
+    Funcs->glVertexAttribIFormat(DrawIndexAttrib, 1, GL_UNSIGNED_INT, 0);
+    Funcs->glVertexAttribBinding(DrawIndexAttrib, DrawIndexAttrib);
+    Funcs->glVertexBindingDivisor(DrawIndexAttrib, 1);
+    Funcs->glEnableVertexAttribArray(DrawIndexAttrib);
+
+    Funcs->glBindVertexArray(0);
+}
+
+void TeapotPatches::release()
+{
+    Funcs->glDeleteBuffers(1, &Buffer);
+    Funcs->glDeleteVertexArrays(1, &VAO);
+    VAO = 0;
+}
+
+void TeapotPatches::draw(GLuint drawIndexBuffer, GLuint baseInstance, GLsizei instanceCount)
+{
+    Funcs->glBindVertexArray(VAO);
+    Funcs->glBindVertexBuffer(DrawIndexAttrib, drawIndexBuffer, 0, sizeof(GLuint));
+
+    Funcs->glPatchParameteri(GL_PATCH_VERTICES, PatchVertices);
+    Funcs->glDrawArraysInstancedBaseInstance(GL_PATCHES, 0, PatchCount * PatchVertices, instanceCount, baseInstance);
+
+    Funcs->glBindVertexArray(0);
+}
+
+void TeapotPatches::drawIndirect(GLuint drawIndexBuffer, GLuint commandBuffer, GLintptr offset)
+{
+    Funcs->glBindVertexArray(VAO);
+    Funcs->glBindVertexBuffer(DrawIndexAttrib, drawIndexBuffer, 0, sizeof(GLuint));
+
+    Funcs->glPatchParameteri(GL_PATCH_VERTICES, PatchVertices);
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    Funcs->glDrawArraysIndirect(GL_PATCHES, ((GLubyte *)NULL + (offset)));
+    Funcs->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    Funcs->glBindVertexArray(0);
+}
+
+int TeapotPatches::getPatchCount() const
+{
+    return PatchCount;
+}
+
+int TeapotPatches::getByteCount() const
+{
+    return PatchCount * PatchVertices * 4 * sizeof(float);
+}
@@ -0,0 +1,37 @@
+#ifndef TEAPOTPATCHES_H
+#define TEAPOTPATCHES_H
+
+#include <QOpenGLFunctions_4_3_Core>
+
+// The teapot as raw Bezier patches for the tessellation shaders: the 32 mirrored patch
+// instances of Teapot::controlPoints(), 16 control points each, drawn as GL_PATCHES.
+// Like the geometry arena, attribute 3 (DrawIndex) is a per-instance uint read from the
+// scene's buffer, so instances find their object record in the ObjectData storage block.
+class TeapotPatches
+{
+public:
+    static const GLuint DrawIndexAttrib = 3;
+    static const int    PatchVertices   = 16;
+
+    TeapotPatches();
+
+    void initialize(QOpenGLFunctions_4_3_Core *funcs);
+    void release();
+
+    // Draws instanceCount teapots starting at object record baseInstance
+    void draw(GLuint drawIndexBuffer, GLuint baseInstance, GLsizei instanceCount);
+    // Same, with the instances of the DrawArraysIndirectCommand at offset in commandBuffer
+    void drawIndirect(GLuint drawIndexBuffer, GLuint commandBuffer, GLintptr offset);
+
+    int getPatchCount() const;
+    int getByteCount() const;
+
+private:
+    QOpenGLFunctions_4_3_Core *Funcs;
+
+    GLuint VAO;
+    GLuint Buffer;
+    int    PatchCount;
+};
+
+#endif // TEAPOTPATCHES_H
@@ -0,0 +1,68 @@
+#include "teapot.h"
+#include "torus.h"
+#include "vboplane.h"
+#include "vertexcache.h"
+
+#include <QCoreApplication>
+#include <QTextStream>
+
+#include <vector>
+
+// Prints ACMR / ATVR of each generated mesh in its generated order and after the
+// reordering applied by GeometryArena::addMesh, for FIFO caches of 16 and 32 entries.
+static void report(QTextStream& out, const char *name, const unsigned int *el, int nIndices, int nVerts)
+{
+    std::vector<unsigned int> indices(el, el + nIndices);
+    VertexCacheStats before16 = analyzeVertexCache(indices.data(), nIndices, nVerts, 16);
+    VertexCacheStats before32 = analyzeVertexCache(indices.data(), nIndices, nVerts, 32);
+
+    optimizeVertexCache(indices.data(), nIndices, nVerts);
+    std::vector<unsigned int> remap;
+    int referenced = optimizeVertexFetch(indices.data(), nIndices, nVerts, remap);
+
+    VertexCacheStats after16 = analyzeVertexCache(indices.data(), nIndices, nVerts, 16);
+    VertexCacheStats after32 = analyzeVertexCache(indices.data(), nIndices, nVerts, 32);
+
+    int indexBytes = nIndices * (nVerts <= 65536 ? 2 : 4);
+
+    out << qSetFieldWidth(16) << left << name << qSetFieldWidth(0)
+        << qSetFieldWidth(8) << right << nVerts << referenced << nIndices / 3 << qSetFieldWidth(0) << "  "
+        << fixed << qSetRealNumberPrecision(3)
+        << "ACMR16 " << before16.acmr << " -> " << after16.acmr << "  "
+        << "ACMR32 " << before32.acmr << " -> " << after32.acmr << "  "
+        << "ATVR16 " << before16.atvr << " -> " << after16.atvr << "  "
+        << "ATVR32 " << before32.atvr << " -> " << after32.atvr << "  "
+        << "index bytes " << nIndices * 4 << " -> " << indexBytes << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    out << qSetFieldWidth(16) << left << "mesh" << qSetFieldWidth(0)
+        << qSetFieldWidth(8) << right << "verts" << "used" << "tris" << qSetFieldWidth(0) << endl;
+
+    // The meshes built by MyWindow::CreateVertexBuffer, plus a few other tessellations
+    const int teapotGrids[] = { 4, 8, 14, 32, 64, 128 };
+    for (int i = 0; i < 6; i++) {
+        Teapot teapot(teapotGrids[i], QMatrix4x4());
+        QByteArray name = "teapot " + QByteArray::number(teapotGrids[i]);
+        report(out, name.constData(), teapot.getelems(), teapot.getnElems(), teapot.getnVerts());
+    }
+
+    const int torusRings[] = { 12, 25, 50, 100 };
+    for (int i = 0; i < 4; i++) {
+        Torus torus(0.7f * 1.5f, 0.3f * 1.5f, torusRings[i], torusRings[i]);
+        QByteArray name = "torus " + QByteArray::number(torusRings[i]);
+        report(out, name.constData(), torus.getel(), 6 * torus.getnFaces(), torus.getnVerts());
+    }
+
+    VBOPlane plane(50.0f, 50.0f, 1, 1);
+    report(out, "plane 1", plane.getelems(), 6 * plane.getnFaces(), plane.getnVerts());
+
+    VBOPlane grid(50.0f, 50.0f, 64, 64);
+    report(out, "plane 64", grid.getelems(), 6 * grid.getnFaces(), grid.getnVerts());
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+# Offline report of the vertex cache efficiency of the generated meshes:
+#   qmake && make && ./meshstats
+
+QT       += core gui concurrent
+
+CONFIG   += c++11 console
+CONFIG   -= app_bundle
+
+TARGET = meshstats
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp \
+    ../../bounds.cpp \
+    ../../teapot.cpp \
+    ../../torus.cpp \
+    ../../vboplane.cpp \
+    ../../vertexcache.cpp
+
+HEADERS += \
+    ../../bounds.h \
+    ../../teapot.h \
+    ../../torus.h \
+    ../../vboplane.h \
+    ../../vertexcache.h
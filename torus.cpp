@@ -27,6 +27,9 @@ Torus::Torus(float outerRadius, float innerRadius, int nsides, int nrings) :
 
     // Generate the vertex data
     generateVerts(v, n, tex, el, outerRadius, innerRadius);
+
+    box = computeBox(v, nVerts);
+    sphere = computeSphere(v, nVerts);
 }
 
 float *Torus::getv()
@@ -59,6 +62,16 @@ int Torus::getnFaces()
     return nFaces;
 }
 
+const BoundingBox& Torus::getBox() const
+{
+    return box;
+}
+
+const BoundingSphere& Torus::getSphere() const
+{
+    return sphere;
+}
+
 
 void Torus::generateVerts(float * verts, float * norms, float * tex,
                              unsigned int * el,
@@ -4,6 +4,8 @@
 #define PI 3.1415926536
 #define TWOPI 2*PI
 
+#include "bounds.h"
+
 class Torus
 {
 private:
@@ -22,6 +24,9 @@ private:
     // Elements
     unsigned int *el;
 
+    BoundingBox    box;
+    BoundingSphere sphere;
+
     void generateVerts(float * , float * ,float *, unsigned int *, float , float);
 
 public:
@@ -35,6 +40,9 @@ public:
     unsigned int *getel();
 
     int    getnFaces();
+
+    const BoundingBox&    getBox() const;
+    const BoundingSphere& getSphere() const;
 };
 
 #endif // TORUS_H
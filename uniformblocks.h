@@ -0,0 +1,132 @@
+#ifndef UNIFORMBLOCKS_H
+#define UNIFORMBLOCKS_H
+
+#include <QMatrix3x3>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+// CPU mirrors of the std140 uniform blocks and std430 storage blocks declared in
+// vshader.txt / fshader.txt / cullshader.txt.
+// Binding points must match the layout(binding = n) qualifiers of the shaders.
+
+enum UniformBinding
+{
+    FrameBinding    = 0,
+    MaterialBinding = 1,
+    CameraBinding   = 2
+};
+
+enum StorageBinding
+{
+    ObjectStorageBinding  = 0,
+    CullObjectBinding     = 1,
+    CullMeshBinding       = 2,
+    CommandStorageBinding = 3,
+    DrawListBinding       = 4,
+    CompactCommandBinding = 5,
+    CullStatsBinding      = 6,
+    PatchCommandBinding   = 7
+};
+
+// Size of the Materials array of MaterialData
+const int MaxMaterials = 8;
+
+// layout (std140, binding = 0) uniform FrameData
+struct FrameBlock
+{
+    float lightPosition[4];
+    float lightIntensity[4];    // vec3, padded
+    float width;
+    float height;
+    float radius;
+    float edgeThreshold;
+};
+
+// layout (std140, binding = 1) uniform MaterialData: MaxMaterials of these
+struct MaterialBlock
+{
+    float ka[4];                // vec3, padded
+    float kd[4];                // vec3, padded
+    float ks[3];
+    float shininess;            // shares the last slot of Ks
+};
+
+// layout (std140, binding = 2) uniform CameraData
+struct CameraBlock
+{
+    float view[16];
+    float projection[16];
+    float viewNormal[12];       // mat3: three columns padded to vec4
+};
+
+// layout (std430, binding = 0) buffer ObjectData: one ObjectInfo per object
+struct ObjectRecord
+{
+    float        model[16];
+    float        modelNormal[12];   // mat3: three columns padded to vec4
+    unsigned int material;
+    unsigned int pad[3];
+};
+
+// layout (std430, binding = 1) buffer CullObjectData: one CullObject per object
+struct CullObjectRecord
+{
+    float        sphere[4];         // world space center, radius
+    unsigned int mesh;
+    int          level;             // written back by the shader, -1 before the first pass
+    unsigned int pad[2];
+};
+
+// layout (std430, binding = 2) buffer CullMeshData: one CullMesh per scene mesh
+struct CullMeshRecord
+{
+    float        minPixelRadius[4]; // per level, see SceneMesh
+    unsigned int firstBucket;
+    unsigned int levelCount;
+    unsigned int pad[2];
+};
+
+// layout (std430, binding = 6) buffer CullStats, followed by one instance count per bucket.
+// drawCount is the parameter of glMultiDrawElementsIndirectCount.
+struct CullStatsHeader
+{
+    unsigned int drawCount;
+    unsigned int drawnObjects;
+    unsigned int occludedObjects;
+    unsigned int pad;
+};
+
+inline void storeVec3(float *dst, const QVector3D& v)
+{
+    dst[0] = v.x();
+    dst[1] = v.y();
+    dst[2] = v.z();
+}
+
+inline void storeVec4(float *dst, const QVector4D& v)
+{
+    dst[0] = v.x();
+    dst[1] = v.y();
+    dst[2] = v.z();
+    dst[3] = v.w();
+}
+
+inline void storeMat4(float *dst, const QMatrix4x4& m)
+{
+    // Both QMatrix4x4 and GLSL are column-major
+    const float *src = m.constData();
+    for (int i = 0; i < 16; i++)
+        dst[i] = src[i];
+}
+
+inline void storeMat3(float *dst, const QMatrix3x3& m)
+{
+    for (int col = 0; col < 3; col++) {
+        for (int row = 0; row < 3; row++)
+            dst[col * 4 + row] = m(row, col);
+        dst[col * 4 + 3] = 0.0f;
+    }
+}
+
+#endif // UNIFORMBLOCKS_H
@@ -0,0 +1,163 @@
+#include "uniformring.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <cstring>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT   0x0080
+#endif
+
+UniformRing::UniformRing()
+    : Funcs(0), Buffer(0), SegmentSize(0), Alignment(256), Persistent(false), Mapped(0),
+      FramesInFlight(Segments), WaitNs(0), Segment(0), Head(0), Flushed(0)
+{
+    for (int i = 0; i < Segments; i++)
+        Fences[i] = 0;
+}
+
+void UniformRing::initialize(QOpenGLContext *context, QOpenGLFunctions_4_3_Core *funcs, GLsizeiptr segmentSize)
+{
+    Funcs = funcs;
+    Funcs->glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+
+    SegmentSize = (segmentSize + Alignment - 1) / Alignment * Alignment;
+    GLsizeiptr size = SegmentSize * Segments;
+
+    Funcs->glGenBuffers(1, &Buffer);
+    Funcs->glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+
+    BufferStorageFunc bufferStorage = 0;
+    if (context->hasExtension("GL_ARB_buffer_storage"))
+        bufferStorage = reinterpret_cast<BufferStorageFunc>(context->getProcAddress("glBufferStorage"));
+
+    if (bufferStorage != 0) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+        Mapped = static_cast<char *>(Funcs->glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+        Persistent = (Mapped != 0);
+    }
+
+    if (!Persistent) {
+        Funcs->glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+        Staging.resize(SegmentSize);
+    }
+
+    Funcs->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    qDebug() << "uniform ring: " << size << "bytes," << (Persistent ? "persistent mapping" : "staged uploads");
+}
+
+void UniformRing::release()
+{
+    for (int i = 0; i < Segments; i++) {
+        if (Fences[i] != 0) Funcs->glDeleteSync(Fences[i]);
+        Fences[i] = 0;
+    }
+
+    if (Persistent) {
+        Funcs->glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+        Funcs->glUnmapBuffer(GL_UNIFORM_BUFFER);
+        Funcs->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    Funcs->glDeleteBuffers(1, &Buffer);
+    Buffer = 0;
+    Mapped = 0;
+}
+
+void UniformRing::setFramesInFlight(int frames)
+{
+    FramesInFlight = qBound(1, frames, (int)Segments);
+}
+
+int UniformRing::getFramesInFlight() const
+{
+    return FramesInFlight;
+}
+
+void UniformRing::beginFrame()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Newest first: once it has signaled, the older fences have too. With every segment in
+    // flight only this frame's own fence is left, normally signaled Segments frames ago.
+    for (int age = FramesInFlight; age <= Segments; age++) {
+        int segment = (Segment + Segments - age) % Segments;
+        if (Fences[segment] == 0) continue;
+
+        Funcs->glClientWaitSync(Fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        Funcs->glDeleteSync(Fences[segment]);
+        Fences[segment] = 0;
+    }
+
+    WaitNs  = timer.nsecsElapsed();
+    Head    = 0;
+    Flushed = 0;
+}
+
+double UniformRing::getWaitMs() const
+{
+    return WaitNs / 1.0e6;
+}
+
+GLintptr UniformRing::push(const void *data, GLsizeiptr size)
+{
+    GLintptr offset = (Head + Alignment - 1) / Alignment * Alignment;
+    if (offset + size > SegmentSize) {
+        qWarning( "Uniform ring segment overflow" );
+        offset = 0;
+    }
+
+    char *dst = Persistent ? Mapped + Segment * SegmentSize : Staging.data();
+    memcpy(dst + offset, data, size);
+    Head = offset + size;
+
+    return Segment * SegmentSize + offset;
+}
+
+void UniformRing::flush()
+{
+    if (Persistent || Head <= Flushed) {
+        Flushed = Head;
+        return;
+    }
+
+    // The fence guarantees the GPU is not reading this range: no need for the driver to sync
+    GLintptr base = Segment * SegmentSize;
+    Funcs->glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+    void *dst = Funcs->glMapBufferRange(GL_UNIFORM_BUFFER, base + Flushed, Head - Flushed,
+                                        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (dst != 0) {
+        memcpy(dst, Staging.constData() + Flushed, Head - Flushed);
+        Funcs->glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    Funcs->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    Flushed = Head;
+}
+
+void UniformRing::bindRange(GLuint binding, GLintptr offset, GLsizeiptr size)
+{
+    Funcs->glBindBufferRange(GL_UNIFORM_BUFFER, binding, Buffer, offset, size);
+}
+
+void UniformRing::endFrame()
+{
+    Fences[Segment] = Funcs->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    Segment = (Segment + 1) % Segments;
+}
+
+GLuint UniformRing::getBuffer() const
+{
+    return Buffer;
+}
+
+bool UniformRing::isPersistent() const
+{
+    return Persistent;
+}
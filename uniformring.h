@@ -0,0 +1,63 @@
+#ifndef UNIFORMRING_H
+#define UNIFORMRING_H
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QVector>
+
+// Ring buffer for uniform data rewritten every frame.
+// The buffer is split in one segment per frame in flight; a frame only writes its own
+// segment and fences it when done, so a segment is reused once the GPU has consumed it.
+// When GL_ARB_buffer_storage is available the buffer is persistently and coherently
+// mapped, otherwise data is staged in memory and written with an unsynchronized map.
+// Fewer frames in flight than segments can be asked for, to measure what the ring buys:
+// with one, every frame waits for the GPU to finish the previous one.
+class UniformRing
+{
+public:
+    static const int Segments = 3;
+
+    UniformRing();
+
+    void initialize(QOpenGLContext *context, QOpenGLFunctions_4_3_Core *funcs, GLsizeiptr segmentSize);
+    void release();
+
+    // 1 to Segments
+    void setFramesInFlight(int frames);
+    int  getFramesInFlight() const;
+
+    // Waits until the GPU is done with the frames older than the ones allowed in flight,
+    // which frees the segment of this frame
+    void beginFrame();
+    // Time blocked on the fences by the last beginFrame()
+    double getWaitMs() const;
+    // Copies data into the frame segment; the returned offset is aligned for glBindBufferRange
+    GLintptr push(const void *data, GLsizeiptr size);
+    // Makes everything pushed since the last flush visible to the GPU
+    void flush();
+    void bindRange(GLuint binding, GLintptr offset, GLsizeiptr size);
+    void endFrame();
+
+    GLuint getBuffer() const;
+    bool   isPersistent() const;
+
+private:
+    typedef void (QOPENGLF_APIENTRYP BufferStorageFunc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+    QOpenGLFunctions_4_3_Core *Funcs;
+    GLuint     Buffer;
+    GLsizeiptr SegmentSize;
+    GLint      Alignment;
+    bool       Persistent;
+    char      *Mapped;          // persistent mapping of the whole buffer
+
+    int        FramesInFlight;
+    qint64     WaitNs;
+    int        Segment;         // segment written this frame
+    GLintptr   Head;            // next write offset inside the segment
+    GLintptr   Flushed;         // start of the data not flushed yet
+    GLsync     Fences[Segments];
+    QVector<char> Staging;      // one segment, when not persistent
+};
+
+#endif // UNIFORMRING_H
@@ -61,6 +61,9 @@ VBOPlane::VBOPlane(float xsize, float zsize, int xdivs, int zdivs, float smax, f
             idx += 6;
         }
     }
+
+    box = computeBox(v, nVerts);
+    sphere = computeSphere(v, nVerts);
 /*
     unsigned int handle[4];
     glGenBuffers(4, handle);
@@ -119,3 +122,13 @@ unsigned int VBOPlane::getnFaces()
 {
     return nFaces;
 }
+
+const BoundingBox& VBOPlane::getBox() const
+{
+    return box;
+}
+
+const BoundingSphere& VBOPlane::getSphere() const
+{
+    return sphere;
+}
@@ -1,6 +1,8 @@
 #ifndef VBOPLANE_H
 #define VBOPLANE_H
 
+#include "bounds.h"
+
 class VBOPlane
 {
 private:
@@ -19,6 +21,9 @@ private:
     // Elements
     unsigned int *el;
 
+    BoundingBox    box;
+    BoundingSphere sphere;
+
 
 public:
     ~VBOPlane();
@@ -30,6 +35,9 @@ public:
     float *gettc();
     unsigned int *getelems();
     unsigned int  getnFaces();
+
+    const BoundingBox&    getBox() const;
+    const BoundingSphere& getSphere() const;
 };
 
 #endif // VBOPLANE_H
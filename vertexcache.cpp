@@ -0,0 +1,196 @@
+#include "vertexcache.h"
+
+#include <cmath>
+
+namespace
+{
+    // Tuning from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+    const int   CacheSize         = 32;
+    const float CacheDecayPower   = 1.5f;
+    const float LastTriScore      = 0.75f;
+    const float ValenceBoostScale = 2.0f;
+    const float ValenceBoostPower = 0.5f;
+
+    float vertexScore(int cachePosition, int activeTris)
+    {
+        // No triangle left to use this vertex
+        if (activeTris == 0) return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // The vertices of the last triangle get a fixed score so that the next
+                // triangle does not simply continue a strip
+                score = LastTriScore;
+            } else {
+                float scale = 1.0f / (CacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scale, CacheDecayPower);
+            }
+        }
+
+        // Favour vertices with few triangles left, so that lone triangles are not stranded
+        score += ValenceBoostScale * std::pow((float)activeTris, -ValenceBoostPower);
+        return score;
+    }
+}
+
+void optimizeVertexCache(unsigned int *indices, int nIndices, int nVerts)
+{
+    int nTris = nIndices / 3;
+    if (nTris == 0) return;
+
+    // Triangles using each vertex: adjacency[offsets[v] .. offsets[v] + activeTris[v]]
+    std::vector<int> activeTris(nVerts, 0);
+    for (int i = 0; i < nIndices; i++)
+        activeTris[indices[i]]++;
+
+    std::vector<int> offsets(nVerts + 1, 0);
+    for (int v = 0; v < nVerts; v++)
+        offsets[v + 1] = offsets[v] + activeTris[v];
+
+    std::vector<int> adjacency(nIndices);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (int i = 0; i < nIndices; i++)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<int>   cachePosition(nVerts, -1);
+    std::vector<float> score(nVerts);
+    for (int v = 0; v < nVerts; v++)
+        score[v] = vertexScore(-1, activeTris[v]);
+
+    std::vector<float> triScore(nTris);
+    std::vector<char>  emitted(nTris, 0);
+    for (int t = 0; t < nTris; t++)
+        triScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+
+    std::vector<unsigned int> output;
+    output.reserve(nTris * 3);
+
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(CacheSize + 3);
+    nextCache.reserve(CacheSize + 3);
+
+    int scanStart = 0;
+    int best = -1;
+
+    while ((int)output.size() < nTris * 3) {
+        if (best < 0) {
+            // Nothing adjacent to the cache: start a new island from the best triangle left
+            while (scanStart < nTris && emitted[scanStart]) scanStart++;
+
+            float bestScore = -1.0f;
+            for (int t = scanStart; t < nTris; t++) {
+                if (!emitted[t] && triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        const unsigned int *tri = indices + 3 * best;
+        emitted[best] = 1;
+
+        // Emit the triangle and drop it from the adjacency of its vertices
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = tri[k];
+            output.push_back(v);
+
+            int *list = &adjacency[offsets[v]];
+            for (int j = 0; j < activeTris[v]; j++) {
+                if (list[j] == best) {
+                    list[j] = list[activeTris[v] - 1];
+                    break;
+                }
+            }
+            activeTris[v]--;
+        }
+
+        // The triangle's vertices move to the front of the LRU cache
+        nextCache.assign(tri, tri + 3);
+        for (size_t i = 0; i < cache.size(); i++) {
+            unsigned int v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                nextCache.push_back(v);
+        }
+        cache.swap(nextCache);
+
+        for (size_t i = 0; i < cache.size(); i++) {
+            unsigned int v = cache[i];
+            cachePosition[v] = i < (size_t)CacheSize ? (int)i : -1;
+            score[v] = vertexScore(cachePosition[v], activeTris[v]);
+        }
+
+        // Rescore the triangles touching the cache and pick the next one among them
+        best = -1;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < cache.size(); i++) {
+            unsigned int v = cache[i];
+            const int *list = &adjacency[offsets[v]];
+            for (int j = 0; j < activeTris[v]; j++) {
+                int t = list[j];
+                triScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        // Vertices that fell out of the cache keep their updated score
+        if (cache.size() > (size_t)CacheSize)
+            cache.resize(CacheSize);
+    }
+
+    for (int i = 0; i < nTris * 3; i++)
+        indices[i] = output[i];
+}
+
+int optimizeVertexFetch(unsigned int *indices, int nIndices, int nVerts, std::vector<unsigned int>& remap)
+{
+    const unsigned int Unused = ~0u;
+    remap.assign(nVerts, Unused);
+
+    unsigned int next = 0;
+    for (int i = 0; i < nIndices; i++) {
+        unsigned int& v = indices[i];
+        if (remap[v] == Unused)
+            remap[v] = next++;
+        v = remap[v];
+    }
+
+    int referenced = next;
+    for (int v = 0; v < nVerts; v++) {
+        if (remap[v] == Unused)
+            remap[v] = next++;
+    }
+
+    return referenced;
+}
+
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, int nIndices, int nVerts, int cacheSize)
+{
+    // Each vertex remembers when it entered the FIFO; it is a hit while it is among the
+    // last cacheSize vertices inserted
+    std::vector<int>  insertedAt(nVerts, -1);
+    std::vector<char> referenced(nVerts, 0);
+    int misses = 0;
+    int uniqueVerts = 0;
+
+    for (int i = 0; i < nIndices; i++) {
+        unsigned int v = indices[i];
+        if (!referenced[v]) {
+            referenced[v] = 1;
+            uniqueVerts++;
+        }
+
+        if (insertedAt[v] < 0 || misses - insertedAt[v] >= cacheSize) {
+            insertedAt[v] = misses;
+            misses++;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.acmr = nIndices > 0 ? (float)misses / (nIndices / 3) : 0.0f;
+    stats.atvr = uniqueVerts > 0 ? (float)misses / uniqueVerts : 0.0f;
+    return stats;
+}
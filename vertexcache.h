@@ -0,0 +1,29 @@
+#ifndef VERTEXCACHE_H
+#define VERTEXCACHE_H
+
+#include <vector>
+
+// Index and vertex reordering for indexed triangle lists.
+// The generated meshes emit their triangles row by row, which reuses few vertices from
+// the post-transform cache. optimizeVertexCache() reorders the triangles with Tom
+// Forsyth's linear-speed algorithm, optimizeVertexFetch() then renumbers the vertices in
+// order of first use so the vertex fetches walk memory linearly.
+
+struct VertexCacheStats
+{
+    float acmr;     // cache misses per triangle: 0.5 is ideal for regular grids, 3 the worst
+    float atvr;     // cache misses per referenced vertex: 1 is ideal
+};
+
+// Reorders the triangles of indices in place, for an LRU cache of 32 entries
+void optimizeVertexCache(unsigned int *indices, int nIndices, int nVerts);
+
+// Renumbers the vertices in order of first use and rewrites indices accordingly.
+// remap[old] receives the new position of every vertex; unreferenced vertices are moved
+// after the referenced ones. Returns the number of referenced vertices.
+int optimizeVertexFetch(unsigned int *indices, int nIndices, int nVerts, std::vector<unsigned int>& remap);
+
+// Simulates a FIFO post-transform cache of cacheSize entries
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, int nIndices, int nVerts, int cacheSize = 16);
+
+#endif // VERTEXCACHE_H
@@ -0,0 +1,181 @@
+#include "vertexformat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    float clampUnit(float value)
+    {
+        return value > 1.0f ? 1.0f : (value < -1.0f ? -1.0f : value);
+    }
+
+    float signNotZero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+}
+
+MeshBounds computeBounds(const float *v, int nVerts)
+{
+    MeshBounds bounds;
+
+    for (int c = 0; c < 3; c++) {
+        float lo = nVerts > 0 ? v[c] : 0.0f;
+        float hi = lo;
+        for (int i = 1; i < nVerts; i++) {
+            lo = std::min(lo, v[3 * i + c]);
+            hi = std::max(hi, v[3 * i + c]);
+        }
+
+        bounds.center[c] = 0.5f * (lo + hi);
+        bounds.extent[c] = 0.5f * (hi - lo);
+        // Flat meshes (the plane): any non-zero extent maps the single value exactly
+        if (bounds.extent[c] <= 0.0f) bounds.extent[c] = 1.0f;
+    }
+
+    return bounds;
+}
+
+MeshBounds mergeBounds(const MeshBounds& a, const MeshBounds& b)
+{
+    MeshBounds bounds;
+
+    for (int c = 0; c < 3; c++) {
+        float lo = std::min(a.center[c] - a.extent[c], b.center[c] - b.extent[c]);
+        float hi = std::max(a.center[c] + a.extent[c], b.center[c] + b.extent[c]);
+        bounds.center[c] = 0.5f * (lo + hi);
+        bounds.extent[c] = 0.5f * (hi - lo);
+    }
+
+    return bounds;
+}
+
+void packVertices(const float *v, const float *n, const float *tc, int nVerts,
+                  const MeshBounds& bounds, PackedVertex *out)
+{
+    for (int i = 0; i < nVerts; i++) {
+        PackedVertex& vertex = out[i];
+
+        for (int c = 0; c < 3; c++) {
+            float q = clampUnit((v[3 * i + c] - bounds.center[c]) / bounds.extent[c]);
+            vertex.position[c] = (short)std::lround(q * 32767.0f);
+        }
+
+        encodeOctahedral(n + 3 * i, vertex.normal);
+
+        vertex.texCoord[0] = floatToHalf(tc != 0 ? tc[2 * i]     : 0.0f);
+        vertex.texCoord[1] = floatToHalf(tc != 0 ? tc[2 * i + 1] : 0.0f);
+    }
+}
+
+unsigned short floatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    unsigned int sign     = (bits >> 16) & 0x8000;
+    int          exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    // Infinity and NaN
+    if (((bits >> 23) & 0xff) == 0xff)
+        return (unsigned short)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    if (exponent >= 31)
+        return (unsigned short)(sign | 0x7c00);
+
+    // Denormals, rounded to nearest even
+    if (exponent <= 0) {
+        if (exponent < -10) return (unsigned short)sign;
+
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        unsigned int half    = mantissa >> shift;
+        unsigned int rest    = mantissa & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return (unsigned short)(sign | half);
+    }
+
+    // Normal numbers; a carry out of the mantissa correctly bumps the exponent
+    unsigned int half = ((unsigned int)exponent << 10) | (mantissa >> 13);
+    unsigned int rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return (unsigned short)(sign | half);
+}
+
+float halfToFloat(unsigned short value)
+{
+    unsigned int sign     = (value & 0x8000) << 16;
+    unsigned int exponent = (value >> 10) & 0x1f;
+    unsigned int mantissa = value & 0x3ff;
+    unsigned int bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Renormalize the denormal
+            int e = -1;
+            do {
+                e++;
+                mantissa <<= 1;
+            } while ((mantissa & 0x400) == 0);
+            bits = sign | ((unsigned int)(127 - 15 - e) << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void encodeOctahedral(const float *n, signed char *out)
+{
+    float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    if (l1 <= 0.0f) {
+        // Degenerate normal (patch poles): decodes to +z
+        out[0] = out[1] = 0;
+        return;
+    }
+
+    float x = n[0] / l1;
+    float y = n[1] / l1;
+    float z = n[2] / l1;
+
+    // Fold the lower hemisphere over the diagonals
+    if (z < 0.0f) {
+        float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+        float fy = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+
+    out[0] = (signed char)std::lround(clampUnit(x) * 127.0f);
+    out[1] = (signed char)std::lround(clampUnit(y) * 127.0f);
+}
+
+void decodeOctahedral(const signed char *in, float *n)
+{
+    // Same as decodeNormal() in vshader.txt
+    float x = std::max(in[0] / 127.0f, -1.0f);
+    float y = std::max(in[1] / 127.0f, -1.0f);
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+
+    if (z < 0.0f) {
+        float fx = (1.0f - std::fabs(y)) * signNotZero(x);
+        float fy = (1.0f - std::fabs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+
+    float length = std::sqrt(x * x + y * y + z * z);
+    n[0] = x / length;
+    n[1] = y / length;
+    n[2] = z / length;
+}
@@ -0,0 +1,34 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+// Interleaved, quantized vertex used by the geometry arena: 12 bytes instead of the
+// 32 bytes of separate float position / normal / tex coord streams.
+//  - position: snorm16 relative to the mesh bounding box (see MeshBounds)
+//  - normal:   octahedral encoding, two snorm8
+//  - texCoord: two half floats
+struct PackedVertex
+{
+    short         position[3];
+    signed char   normal[2];
+    unsigned short texCoord[2];
+};
+
+// Maps snorm positions back to object space: p = center + extent * q
+struct MeshBounds
+{
+    float center[3];
+    float extent[3];
+};
+
+MeshBounds computeBounds(const float *v, int nVerts);
+// Box holding both a and b, e.g. to quantize every level of a LOD chain alike
+MeshBounds mergeBounds(const MeshBounds& a, const MeshBounds& b);
+void packVertices(const float *v, const float *n, const float *tc, int nVerts,
+                  const MeshBounds& bounds, PackedVertex *out);
+
+unsigned short floatToHalf(float value);
+float          halfToFloat(unsigned short value);
+void           encodeOctahedral(const float *n, signed char *out);
+void           decodeOctahedral(const signed char *in, float *n);
+
+#endif // VERTEXFORMAT_H